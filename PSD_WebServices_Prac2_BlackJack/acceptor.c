@@ -0,0 +1,84 @@
+#include "acceptor.h"
+#include <sys/socket.h>
+
+static void *acceptLoop(void *arg) {
+
+  tAcceptor *acceptor = (tAcceptor *)arg;
+  SOAP_SOCKET s;
+
+  while (TRUE) {
+
+    s = soap_accept(acceptor->soap);
+
+    // Sin conexiones en accept_timeout: se sigue esperando (hay mas hilos)
+    if (!soap_valid_socket(s)) {
+      if (acceptor->soap->errnum) {
+        soap_print_fault(acceptor->soap, stderr);
+        exit(1);
+      }
+      continue;
+    }
+
+    // Solo se cancela dentro de soap_accept, nunca con la cola bloqueada
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    enqueueSocket(&(acceptor->pool), s);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+  }
+
+  return NULL;
+}
+
+/**
+ * Releases the listening soap context of an acceptor (and closes its socket).
+ */
+static void freeSoap(tAcceptor *acceptor) {
+
+  soap_destroy(acceptor->soap);
+  soap_end(acceptor->soap);
+  soap_free(acceptor->soap);
+  acceptor->soap = NULL;
+}
+
+int initAcceptor(tAcceptor *acceptor, struct soap *master, int index, int port,
+                 int backlog, int numWorkers, int queueSize) {
+
+  acceptor->index = index;
+  acceptor->soap = soap_copy(master);
+  if (acceptor->soap == NULL)
+    return -1;
+
+  // Cada aceptador tiene su propio socket en el mismo puerto
+  acceptor->soap->bind_flags = SO_REUSEPORT;
+  if (!soap_valid_socket(soap_bind(acceptor->soap, NULL, port, backlog))) {
+    soap_print_fault(acceptor->soap, stderr);
+    freeSoap(acceptor);
+    return -1;
+  }
+
+  // Los workers copian el contexto ya enlazado (como con el maestro)
+  if (initWorkerPool(&(acceptor->pool), acceptor->soap, numWorkers, queueSize,
+                     NULL) != 0) {
+    freeSoap(acceptor);
+    return -1;
+  }
+
+  return 0;
+}
+
+int startAcceptor(tAcceptor *acceptor) {
+  return pthread_create(&(acceptor->thread), NULL, acceptLoop, acceptor) == 0
+             ? 0
+             : -1;
+}
+
+void stopAcceptor(tAcceptor *acceptor, int started) {
+
+  // accept es un punto de cancelacion: el hilo sale sin tener nada a medias
+  if (started) {
+    pthread_cancel(acceptor->thread);
+    pthread_join(acceptor->thread, NULL);
+  }
+
+  stopWorkerPool(&(acceptor->pool));
+  freeSoap(acceptor);
+}
@@ -0,0 +1,63 @@
+#ifndef ACCEPTOR_H
+#define ACCEPTOR_H
+
+#include "pool.h"
+#include "soapH.h"
+#include <pthread.h>
+
+/** Default backlog of the listening sockets */
+#define DEFAULT_BACKLOG 100
+
+/** Default number of acceptors */
+#define DEFAULT_ACCEPTORS 1
+
+/**
+ * Accept thread with its own listening socket, bound with SO_REUSEPORT to the
+ * same port as the other acceptors, and its own set of workers. The kernel
+ * spreads the new connections across the sockets, so the acceptors never
+ * share a lock: neither in accept nor in the job queue.
+ */
+typedef struct acceptor {
+
+  int index;         /** Position of this acceptor */
+  struct soap *soap; /** Listening soap context (copy of the master) */
+  tWorkerPool pool;  /** Workers that serve the connections it accepts */
+  pthread_t thread;  /** Thread running the accept loop */
+} tAcceptor;
+
+/**
+ * Binds a new listening socket (SO_REUSEPORT) and spawns the workers of the
+ * acceptor. It does not accept connections until startAcceptor is called. On
+ * error, whatever was already created is released (and the bind error is
+ * printed).
+ *
+ * @param acceptor Acceptor to be initialized.
+ * @param master Master soap context (not bound), copied by the acceptor.
+ * @param index Position of this acceptor.
+ * @param port Port to listen on.
+ * @param backlog Backlog of the listening socket.
+ * @param numWorkers Number of workers of this acceptor.
+ * @param queueSize Capacity of the job queue of this acceptor.
+ * @return 0 on success, -1 on error.
+ */
+int initAcceptor(tAcceptor *acceptor, struct soap *master, int index, int port,
+                 int backlog, int numWorkers, int queueSize);
+
+/**
+ * Starts the accept loop of an acceptor, in its own thread.
+ *
+ * @param acceptor Acceptor (already initialized).
+ * @return 0 on success, -1 on error.
+ */
+int startAcceptor(tAcceptor *acceptor);
+
+/**
+ * Stops an acceptor: its accept loop (if it was started), its workers and its
+ * listening socket.
+ *
+ * @param acceptor Acceptor.
+ * @param started TRUE if startAcceptor was called on it.
+ */
+void stopAcceptor(tAcceptor *acceptor, int started);
+
+#endif
@@ -0,0 +1,141 @@
+#include "binary.h"
+#include "logger.h"
+#include "messages.h"
+#include "server.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void *acceptLoop(void *arg) {
+
+  tBinaryListener *listener = (tBinaryListener *)arg;
+  tJob job = {SOAP_INVALID_SOCKET, NULL, serveBinary};
+  int fd;
+
+  while (TRUE) {
+
+    fd = accept(listener->socket, NULL, NULL);
+
+    if (fd < 0) {
+
+      // La conexion se ha cerrado antes de aceptarla: se sigue sin mas
+      if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+        continue;
+
+      // Sin descriptores o sin memoria: se espera a que se liberen, en lugar
+      // de reintentar sin parar (la conexion sigue en el backlog)
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM) {
+        logEvent(logWarning, "[Binary] accept failed (errno %d), backing off",
+                 NULL, errno, 0);
+        usleep(BINARY_ACCEPT_BACKOFF * 1000);
+        continue;
+      }
+
+      // Cualquier otro error no se arregla esperando, como en acceptor.c
+      perror("Error accepting a binary connection");
+      exit(1);
+    }
+
+    job.socket = fd;
+    enqueueJob(listener->pool, job);
+  }
+
+  return NULL;
+}
+
+int initBinaryListener(tBinaryListener *listener, int port, int backlog,
+                       int reusePort, tWorkerPool *pool) {
+
+  struct sockaddr_in address;
+  int one = 1;
+
+  listener->pool = pool;
+  listener->socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (listener->socket < 0)
+    return -1;
+
+  setsockopt(listener->socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (reusePort)
+    setsockopt(listener->socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+
+  if (bind(listener->socket, (struct sockaddr *)&address, sizeof(address)) <
+          0 ||
+      listen(listener->socket, backlog) < 0) {
+    close(listener->socket);
+    return -1;
+  }
+
+  if (pthread_create(&(listener->thread), NULL, acceptLoop, listener) != 0)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * Serves one request with the same functions of the SOAP service.
+ *
+ * @return Length of the response, or -1 if the request is not valid or it
+ * failed (the journal could not confirm it): the connection is closed.
+ */
+static int serveFrame(struct soap *soap, uint8_t *frame, int length) {
+
+  char name[STRING_LENGTH];
+  tWireRequest request;
+  blackJackns__tBlock status;
+  int result;
+
+  request.playerName.msg = name;
+  if (wireUnpackRequest(frame, length, &request) != 0)
+    return -1;
+
+  switch (request.op) {
+  case WIRE_REGISTER:
+    if (blackJackns__register(soap, request.playerName, &result) != SOAP_OK)
+      return -1;
+    return wirePackResponse(frame, result, NULL);
+  case WIRE_GET_STATUS:
+    blackJackns__getStatus(soap, request.playerName, request.gameId, &status);
+    return wirePackResponse(frame, status.code, &status);
+  case WIRE_PLAYER_MOVE:
+    if (blackJackns__playerMove(soap, request.playerName, request.gameId,
+                                request.action, &status) != SOAP_OK)
+      return -1;
+    return wirePackResponse(frame, status.code, &status);
+  default:
+    return -1;
+  }
+}
+
+void serveBinary(tWorker *worker, tJob *job) {
+
+  struct soap *soap = worker->soap;
+  struct timeval timeout = {soap->recv_timeout, 0};
+  uint8_t frame[WIRE_MAX_FRAME];
+  int length;
+
+  // Mismo timeout que las conexiones SOAP
+  setsockopt(job->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // Los clientes binarios siempre reciben los codigos de los mensajes
+  strcpy(soap->path, MSG_CODES_PATH);
+
+  while ((length = wireReadFrame(job->socket, frame)) >= 0) {
+
+    // El contexto del worker solo se usa para reservar memoria (soap_malloc)
+    length = serveFrame(soap, frame, length);
+    soap_destroy(soap);
+    soap_end(soap);
+
+    if (length < 0 || wireWriteFrame(job->socket, frame, length) != 0)
+      break;
+  }
+
+  close(job->socket);
+}
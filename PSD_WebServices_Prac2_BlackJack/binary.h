@@ -0,0 +1,49 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include "pool.h"
+#include "wire.h"
+#include <pthread.h>
+
+/** Wait after accept runs out of descriptors or memory (in milliseconds) */
+#define BINARY_ACCEPT_BACKOFF 100
+
+/**
+ * Listener of the binary protocol (see wire.h). Accepted connections are
+ * served by the same worker pool and game logic as the SOAP ones.
+ *
+ * The binary protocol does not use the reactor: each connection keeps one
+ * worker until the client closes it (or recv_timeout expires), even with
+ * --reactor, and a getStatus blocks that worker until the turn arrives. The
+ * pool needs at least one worker per binary client.
+ */
+typedef struct binaryListener {
+
+  int socket;        /** Listening socket */
+  pthread_t thread;  /** Thread that accepts the connections */
+  tWorkerPool *pool; /** Workers that serve the connections */
+} tBinaryListener;
+
+/**
+ * Binds the binary port and starts accepting connections.
+ *
+ * @param listener Listener to be initialized.
+ * @param port Port of the binary protocol.
+ * @param backlog Backlog of the listening socket.
+ * @param reusePort TRUE to share the port with other processes (SO_REUSEPORT).
+ * @param pool Workers that serve the connections.
+ * @return 0 on success, -1 on error.
+ */
+int initBinaryListener(tBinaryListener *listener, int port, int backlog,
+                       int reusePort, tWorkerPool *pool);
+
+/**
+ * Job handler: serves all the frames of a binary connection, until the client
+ * closes it. It holds the worker for the whole connection.
+ *
+ * @param worker Worker serving the job.
+ * @param job Job with the accepted socket.
+ */
+void serveBinary(tWorker *worker, tJob *job);
+
+#endif
@@ -52,6 +52,130 @@ unsigned int readOption() {
   return bet;
 }
 
+/** Socket of the binary protocol (bin:// URL), -1 to use SOAP */
+int binarySocket = -1;
+
+/**
+ * Sends a request with the binary protocol. On error, the soap context keeps
+ * the error so it is printed like the SOAP ones.
+ */
+static int callBinary(struct soap *soap, tWireRequest *request,
+                      blackJackns__tBlock *status) {
+
+  if (wireCall(binarySocket, request, status) != 0)
+    return soap->error = SOAP_EOF;
+
+  renderMessage(soap, &(status->msgStruct));
+  return SOAP_OK;
+}
+
+/**
+ * Checks if the connection of the session (keep-alive) was already open
+ * before a call.
+ */
+static int keptAlive(struct soap *soap) {
+  return soap->keep_alive && soap_valid_socket(soap->socket);
+}
+
+/**
+ * Decides if a failed getStatus must be repeated on a new connection: only
+ * once, and only if it failed because a reused connection had been closed by
+ * the server (idle timeout or max_keep_alive). Only getStatus is repeated: it
+ * does not change the game, while a register or a move may have been served
+ * before the connection was lost.
+ */
+static int reconnect(struct soap *soap, int *reused) {
+
+  if (!*reused || (soap->error != SOAP_EOF && soap->error != SOAP_TCP_ERROR))
+    return FALSE;
+
+  // La siguiente llamada abre una conexion nueva
+  soap_force_closesock(soap);
+  *reused = FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Closes a kept-alive connection if the server has already closed its end,
+ * so the next call opens a new one. Used before the calls that cannot be
+ * repeated.
+ */
+static void dropClosed(struct soap *soap) {
+
+  struct pollfd fds = {soap->socket, POLLIN, 0};
+  char byte;
+
+  if (!keptAlive(soap))
+    return;
+
+  // Legible sin haber pedido nada: el servidor la ha cerrado (o es basura)
+  if (poll(&fds, 1, 0) > 0 &&
+      ((fds.revents & (POLLERR | POLLHUP)) ||
+       recv(soap->socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT) <= 0))
+    soap_force_closesock(soap);
+}
+
+static int callRegister(struct soap *soap, char *serverURL,
+                        blackJackns__tMessage playerName, int *result) {
+
+  tWireRequest request = {WIRE_REGISTER, 0, 0, playerName};
+  blackJackns__tBlock status;
+
+  // No se repite: el servidor podria haberlo sentado ya
+  if (binarySocket < 0) {
+    dropClosed(soap);
+    return soap_call_blackJackns__register(soap, serverURL, "", playerName,
+                                           result);
+  }
+
+  allocClearBlock(soap, &status);
+  if (callBinary(soap, &request, &status) != SOAP_OK)
+    return soap->error;
+
+  *result = status.code;
+  return SOAP_OK;
+}
+
+static int callGetStatus(struct soap *soap, char *serverURL,
+                         blackJackns__tMessage playerName, int gameId,
+                         blackJackns__tBlock *status) {
+
+  tWireRequest request = {WIRE_GET_STATUS, gameId, 0, playerName};
+  int reused = keptAlive(soap);
+
+  if (binarySocket >= 0)
+    return callBinary(soap, &request, status);
+
+  while (soap_call_blackJackns__getStatus(soap, serverURL, "", playerName,
+                                          gameId, status) != SOAP_OK)
+    if (!reconnect(soap, &reused))
+      return soap->error;
+
+  // Con la URL .../codes el servidor solo envia el id del mensaje
+  renderMessage(soap, &(status->msgStruct));
+  return SOAP_OK;
+}
+
+static int callPlayerMove(struct soap *soap, char *serverURL,
+                          blackJackns__tMessage playerName, int gameId,
+                          int action, blackJackns__tBlock *status) {
+
+  tWireRequest request = {WIRE_PLAYER_MOVE, gameId, action, playerName};
+
+  if (binarySocket >= 0)
+    return callBinary(soap, &request, status);
+
+  // No se repite: la jugada podria haberse hecho ya (otra carta)
+  dropClosed(soap);
+  if (soap_call_blackJackns__playerMove(soap, serverURL, "", playerName,
+                                        gameId, action, status) != SOAP_OK)
+    return soap->error;
+
+  renderMessage(soap, &(status->msgStruct));
+  return SOAP_OK;
+}
+
 int main(int argc, char **argv) {
 
   struct soap soap;                 /** Soap struct */
@@ -66,16 +190,29 @@ int main(int argc, char **argv) {
 
   // Check arguments
   if (argc != 2) {
-    printf("Usage: %s http://server:port\n", argv[0]);
+    printf("Usage: %s http://server:port[/codes] | bin://server:port\n",
+           argv[0]);
     exit(0);
   }
 
-  // Init gSOAP environment
-  soap_init(&soap);
+  // Init gSOAP environment: session mode, the same connection is reused by
+  // all the calls (the server keeps it alive)
+  soap_init1(&soap, SOAP_IO_KEEPALIVE);
 
   // Obtain server address
   serverURL = argv[1];
 
+  // Protocolo binario: una sola conexion para toda la partida
+  if (strncmp(serverURL, WIRE_URL_PREFIX, strlen(WIRE_URL_PREFIX)) == 0) {
+    binarySocket = wireConnect(serverURL);
+
+    if (binarySocket < 0) {
+      printf("Error connecting to %s\n", serverURL);
+      soap_done(&soap);
+      return 1;
+    }
+  }
+
   // Allocate memory
   allocClearMessage(&soap, &(playerName));
   allocClearBlock(&soap, &gameStatus);
@@ -94,8 +231,7 @@ int main(int argc, char **argv) {
     printf("Registering player %s...\n", playerName.msg);
 
     // Call register service
-    if (soap_call_blackJackns__register(&soap, serverURL, "", playerName,
-                                        &resCode) == SOAP_OK) {
+    if (callRegister(&soap, serverURL, playerName, &resCode) == SOAP_OK) {
 
       if (resCode >= 0) {
         // Registration successful
@@ -137,8 +273,8 @@ int main(int argc, char **argv) {
   while (!gameFinished) {
 
     // Get game status
-    if (soap_call_blackJackns__getStatus(&soap, serverURL, "", playerName,
-                                         gameId, &gameStatus) == SOAP_OK) {
+    if (callGetStatus(&soap, serverURL, playerName, gameId, &gameStatus) ==
+        SOAP_OK) {
 
       // Check if player was found
       if (gameStatus.code == ERROR_PLAYER_NOT_FOUND) {
@@ -172,9 +308,8 @@ int main(int argc, char **argv) {
           playerMove = readOption();
 
           // Call playerMove service
-          if (soap_call_blackJackns__playerMove(&soap, serverURL, "",
-                                                playerName, gameId, playerMove,
-                                                &gameStatus) == SOAP_OK) {
+          if (callPlayerMove(&soap, serverURL, playerName, gameId,
+                             playerMove, &gameStatus) == SOAP_OK) {
 
             // Print result of the move
             printf("\n--- Move Result ---\n");
@@ -219,6 +354,8 @@ int main(int argc, char **argv) {
   printf("Game ended. Thank you for playing!\n");
 
   // Cleanup
+  if (binarySocket >= 0)
+    close(binarySocket);
   soap_destroy(&soap);
   soap_end(&soap);
   soap_done(&soap);
@@ -1,6 +1,11 @@
 #include "blackJackns.nsmap"
 #include "game.h"
+#include "messages.h"
 #include "soapH.h"
+#include "wire.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 /** Debug mode? */
 #define DEBUG_CLIENT FALSE
@@ -0,0 +1,614 @@
+#include "journal.h"
+#include "logger.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** Images written to the snapshot at once */
+#define SNAPSHOT_BATCH 64
+
+/**
+ * Checksum of a block of memory (FNV-1a, 32 bits).
+ */
+static uint32_t checksum(const void *data, size_t size) {
+
+  const unsigned char *bytes = (const unsigned char *)data;
+  uint32_t hash = 2166136261U;
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+/**
+ * Checksum of a record: everything after the checksum field.
+ */
+static uint32_t recordChecksum(tJournalRecord *record) {
+  return checksum(&(record->lsn),
+                  sizeof(tJournalRecord) - offsetof(tJournalRecord, lsn));
+}
+
+static void saveImage(tGameImage *image, tGame *game) {
+
+  image->id = game->id;
+  image->status = game->status;
+  image->currentPlayer = game->currentPlayer;
+  image->endOfGame = game->endOfGame;
+  image->player1Stood = game->player1Stood;
+  image->player2Stood = game->player2Stood;
+  image->player1Score = game->player1Score;
+  image->player2Score = game->player2Score;
+  image->player1Bet = game->player1Bet;
+  image->player1Stack = game->player1Stack;
+  image->player1Nonce = game->player1Nonce;
+  image->player2Bet = game->player2Bet;
+  image->player2Stack = game->player2Stack;
+  image->player2Nonce = game->player2Nonce;
+  image->rng = game->rng;
+  image->player1Deck = game->player1Deck;
+  image->player2Deck = game->player2Deck;
+  image->gameDeck = game->gameDeck;
+  memcpy(image->player1Name, game->player1Name, STRING_LENGTH);
+  memcpy(image->player2Name, game->player2Name, STRING_LENGTH);
+}
+
+/**
+ * Copies an image over its game, allocating the game (with its original id)
+ * if needed. Only called at startup, before the workers run.
+ */
+static int loadImage(tJournal *journal, tGameImage *image) {
+
+  tGame *game = allocGame(journal->table, image->id);
+
+  if (game == NULL) {
+    logEvent(logError, "[Journal] ERROR: Game %d does not fit in the table",
+             NULL, image->id, 0);
+    return -1;
+  }
+
+  game->status = image->status;
+  game->currentPlayer = image->currentPlayer;
+  game->endOfGame = image->endOfGame;
+  game->player1Stood = image->player1Stood;
+  game->player2Stood = image->player2Stood;
+  game->player1Score = image->player1Score;
+  game->player2Score = image->player2Score;
+  game->player1Bet = image->player1Bet;
+  game->player1Stack = image->player1Stack;
+  game->player1Nonce = image->player1Nonce;
+  game->player2Bet = image->player2Bet;
+  game->player2Stack = image->player2Stack;
+  game->player2Nonce = image->player2Nonce;
+  game->rng = image->rng;
+  game->player1Deck = image->player1Deck;
+  game->player2Deck = image->player2Deck;
+  game->gameDeck = image->gameDeck;
+  memcpy(game->player1Name, image->player1Name, STRING_LENGTH);
+  memcpy(game->player2Name, image->player2Name, STRING_LENGTH);
+
+  // Un registro roto podria dejar los nombres sin terminar
+  game->player1Name[STRING_LENGTH - 1] = 0;
+  game->player2Name[STRING_LENGTH - 1] = 0;
+
+  return 0;
+}
+
+static void journalPath(tJournal *journal, char *path, size_t size,
+                        uint64_t generation) {
+  snprintf(path, size, "%s/journal.%llu", journal->dir,
+           (unsigned long long)generation);
+}
+
+/**
+ * Flushes the directory, so created, renamed and deleted files survive a
+ * crash.
+ */
+static void syncDir(tJournal *journal) {
+
+  int fd = open(journal->dir, O_RDONLY | O_DIRECTORY);
+
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+static int writeAll(int fd, const char *data, size_t size) {
+
+  ssize_t written;
+
+  while (size > 0) {
+    written = write(fd, data, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written < 0)
+      return -1;
+    data += written;
+    size -= written;
+  }
+
+  return 0;
+}
+
+/**
+ * Creates (or truncates) the journal file of a generation.
+ */
+static int createJournalFile(tJournal *journal, uint64_t generation) {
+
+  char path[512];
+  int fd;
+
+  journalPath(journal, path, sizeof(path), generation);
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd >= 0)
+    syncDir(journal);
+
+  return fd;
+}
+
+/**
+ * Deletes the journal files older than a generation (already in a snapshot).
+ */
+static void deleteJournals(tJournal *journal, uint64_t generation) {
+
+  char path[512];
+
+  for (; journal->oldest < generation; journal->oldest++) {
+    journalPath(journal, path, sizeof(path), journal->oldest);
+    unlink(path);
+  }
+
+  syncDir(journal);
+}
+
+/**
+ * Maps a whole file (read only).
+ *
+ * @return The memory (NULL if the file is empty), or MAP_FAILED if the file
+ * does not exist or cannot be mapped.
+ */
+static void *mapFile(const char *path, size_t *size) {
+
+  struct stat info;
+  void *data = NULL;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    return MAP_FAILED;
+
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return MAP_FAILED;
+  }
+
+  *size = info.st_size;
+  if (*size > 0) {
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+      madvise(data, *size, MADV_SEQUENTIAL);
+  }
+
+  close(fd);
+  return data;
+}
+
+/**
+ * Loads the snapshot into the table, and gets the first generation to be
+ * replayed after it (1 if there is no snapshot).
+ *
+ * @return Number of games loaded, or -1 on error.
+ */
+static int loadSnapshot(tJournal *journal, uint64_t *generation) {
+
+  char path[512];
+  size_t size;
+  tSnapshotHeader *header;
+  tGameImage *images;
+  int loaded = 0;
+
+  snprintf(path, sizeof(path), "%s/%s", journal->dir, SNAPSHOT_FILE);
+  header = (tSnapshotHeader *)mapFile(path, &size);
+
+  // Primer arranque con este directorio
+  if (header == MAP_FAILED && errno == ENOENT) {
+    *generation = 1;
+    return 0;
+  }
+
+  if (header == MAP_FAILED || header == NULL ||
+      size < sizeof(tSnapshotHeader) || header->magic != JOURNAL_MAGIC ||
+      header->imageSize != sizeof(tGameImage) ||
+      (size - sizeof(tSnapshotHeader)) / sizeof(tGameImage) < header->count) {
+    logEvent(logError, "[Journal] ERROR: Invalid snapshot", NULL, 0, 0);
+    if (header != MAP_FAILED && header != NULL)
+      munmap(header, size);
+    return -1;
+  }
+
+  images = (tGameImage *)(header + 1);
+  for (uint64_t i = 0; i < header->count; i++) {
+    if (loadImage(journal, &images[i]) != 0) {
+      munmap(header, size);
+      return -1;
+    }
+    loaded++;
+  }
+
+  *generation = header->generation;
+  munmap(header, size);
+  return loaded;
+}
+
+/**
+ * Replays a journal file, up to the end or to the first torn record.
+ *
+ * @return Number of records replayed, -1 if the file does not exist, or -2 on
+ * error.
+ */
+static int replayJournal(tJournal *journal, uint64_t generation) {
+
+  char path[512];
+  size_t size, offset;
+  char *data;
+  tJournalRecord *record;
+  int replayed = 0;
+
+  journalPath(journal, path, sizeof(path), generation);
+  data = (char *)mapFile(path, &size);
+  if (data == MAP_FAILED)
+    return (errno == ENOENT) ? -1 : -2;
+
+  for (offset = 0; offset + sizeof(tJournalRecord) <= size;
+       offset += sizeof(tJournalRecord)) {
+    record = (tJournalRecord *)(data + offset);
+
+    // Cola rota por una caida: lo que sigue nunca se confirmo
+    if (record->magic != JOURNAL_MAGIC ||
+        record->checksum != recordChecksum(record)) {
+      logEvent(logWarning, "[Journal] Torn record %d of journal %d ignored",
+               NULL, replayed, (int)generation);
+      break;
+    }
+
+    if (loadImage(journal, &(record->image)) != 0) {
+      munmap(data, size);
+      return -2;
+    }
+    replayed++;
+  }
+
+  if (data != NULL)
+    munmap(data, size);
+
+  return replayed;
+}
+
+/**
+ * Writes a snapshot of the non-empty games of the table. Each game is locked
+ * only while it is copied. The snapshot is written to a temporary file and
+ * renamed, so a crash never leaves a half-written snapshot.
+ *
+ * @param generation First journal to be replayed after this snapshot.
+ * @return Number of games written, or -1 on error.
+ */
+static int writeSnapshot(tJournal *journal, uint64_t generation) {
+
+  char path[512], tmpPath[512];
+  tSnapshotHeader header = {JOURNAL_MAGIC, sizeof(tGameImage), generation, 0};
+  tGameImage *batch;
+  tGame *game;
+  int fd, pending = 0, error = 0;
+
+  snprintf(path, sizeof(path), "%s/%s", journal->dir, SNAPSHOT_FILE);
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+  batch = (tGameImage *)malloc(SNAPSHOT_BATCH * sizeof(tGameImage));
+  if (batch == NULL)
+    return -1;
+
+  fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    free(batch);
+    return -1;
+  }
+
+  // La cabecera se reescribe al final, con el numero de juegos
+  error = writeAll(fd, (char *)&header, sizeof(header));
+
+  for (int id = 0; id < journal->table->maxGames && !error; id++) {
+    game = getGame(journal->table, id);
+    if (game == NULL)
+      continue;
+
+    metricsLock(&game->mutex);
+    if (game->status != gameEmpty)
+      saveImage(&batch[pending++], game);
+    pthread_mutex_unlock(&game->mutex);
+
+    if (pending == SNAPSHOT_BATCH) {
+      error = writeAll(fd, (char *)batch, pending * sizeof(tGameImage));
+      header.count += pending;
+      pending = 0;
+    }
+  }
+
+  if (!error && pending > 0) {
+    error = writeAll(fd, (char *)batch, pending * sizeof(tGameImage));
+    header.count += pending;
+  }
+
+  free(batch);
+
+  if (error || pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      fdatasync(fd) != 0) {
+    close(fd);
+    unlink(tmpPath);
+    return -1;
+  }
+
+  close(fd);
+  if (rename(tmpPath, path) != 0)
+    return -1;
+  syncDir(journal);
+
+  return (int)header.count;
+}
+
+/**
+ * Writer thread: writes the active buffer with one write and one fdatasync
+ * (group commit), and rotates the journal file when asked to.
+ */
+static void *writerThread(void *arg) {
+
+  tJournal *journal = (tJournal *)arg;
+  char *batch;
+  size_t size;
+  uint64_t lastLsn;
+  int rotate, failed, fd;
+
+  while (TRUE) {
+
+    metricsLock(&journal->mutex);
+    while (journal->used == 0 && !journal->rotate)
+      pthread_cond_wait(&journal->pending, &journal->mutex);
+
+    // Cambiar de buffer: lo que llegue mientras se escribe va al otro
+    batch = journal->buffers[journal->active];
+    size = journal->used;
+    lastLsn = journal->nextLsn - 1;
+    rotate = journal->rotate;
+    failed = journal->failed;
+    journal->active = 1 - journal->active;
+    journal->used = 0;
+    pthread_mutex_unlock(&journal->mutex);
+
+    // Sin reintentos: tras un fdatasync fallido las paginas pueden haberse
+    // perdido, asi que nada de lo que venga despues se confirma
+    if (size > 0 && !failed &&
+        (writeAll(journal->fd, batch, size) != 0 ||
+         fdatasync(journal->fd) != 0)) {
+      logEvent(logError,
+               "[Journal] ERROR: Cannot write the journal, moves are no "
+               "longer confirmed",
+               NULL, 0, 0);
+      failed = TRUE;
+    }
+
+    // Todo lo anterior ya esta en disco: el siguiente snapshot lo cubre
+    fd = -1;
+    if (rotate && !failed) {
+      fd = createJournalFile(journal, journal->generation + 1);
+      if (fd >= 0) {
+        close(journal->fd);
+        journal->fd = fd;
+      } else {
+        logEvent(logError, "[Journal] ERROR: Cannot rotate the journal", NULL,
+                 0, 0);
+      }
+    }
+
+    metricsLock(&journal->mutex);
+    if (failed)
+      journal->failed = TRUE;
+    else
+      __atomic_store_n(&(journal->durableLsn), lastLsn, __ATOMIC_RELEASE);
+    journal->sinceSnapshot += size / sizeof(tJournalRecord);
+    if (rotate) {
+      if (fd >= 0)
+        journal->generation++;
+      journal->rotate = FALSE;
+      journal->sinceSnapshot = 0;
+    }
+    if (journal->sinceSnapshot >= JOURNAL_SNAPSHOT_RECORDS)
+      pthread_cond_signal(&journal->snapshot);
+    pthread_cond_broadcast(&journal->flushed);
+    pthread_mutex_unlock(&journal->mutex);
+  }
+
+  return NULL;
+}
+
+/**
+ * Snapshot thread: every JOURNAL_SNAPSHOT_RECORDS records, rotates the
+ * journal, dumps the table and deletes the journal files it covers.
+ */
+static void *snapshotThread(void *arg) {
+
+  tJournal *journal = (tJournal *)arg;
+  uint64_t generation;
+  unsigned long long start;
+  int count;
+
+  while (TRUE) {
+
+    metricsLock(&journal->mutex);
+    while (journal->sinceSnapshot < JOURNAL_SNAPSHOT_RECORDS)
+      pthread_cond_wait(&journal->snapshot, &journal->mutex);
+
+    journal->rotate = TRUE;
+    pthread_cond_signal(&journal->pending);
+    while (journal->rotate)
+      pthread_cond_wait(&journal->flushed, &journal->mutex);
+
+    generation = journal->generation;
+    pthread_mutex_unlock(&journal->mutex);
+
+    // No se pudo rotar: el journal actual sigue siendo necesario
+    if (generation == journal->oldest)
+      continue;
+
+    start = metricsNow();
+    count = writeSnapshot(journal, generation);
+
+    if (count < 0) {
+      logEvent(logError, "[Journal] ERROR: Cannot write the snapshot", NULL,
+               0, 0);
+      continue;
+    }
+
+    deleteJournals(journal, generation);
+    logEvent(logInfo, "[Journal] Snapshot of %d games written in %d ms", NULL,
+             count, (int)((metricsNow() - start) / 1000000));
+  }
+
+  return NULL;
+}
+
+int openJournal(tJournal *journal, const char *dir, tGameTable *table) {
+
+  unsigned long long start = metricsNow();
+  uint64_t generation;
+  int records, count;
+
+  snprintf(journal->dir, sizeof(journal->dir), "%s", dir);
+  journal->table = table;
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    return -1;
+
+  // 1. Snapshot mapeado en memoria
+  if (loadSnapshot(journal, &generation) < 0)
+    return -1;
+  journal->oldest = generation;
+
+  // 2. Cola del journal: un fichero por generacion, hasta el primero que falte
+  while ((records = replayJournal(journal, generation)) >= 0) {
+    journal->replayedRecords += records;
+    generation++;
+  }
+  if (records == -2)
+    return -1;
+
+  // 3. Nuevo journal y snapshot de lo recuperado: los ficheros viejos sobran
+  journal->generation = generation;
+  journal->fd = createJournalFile(journal, generation);
+  if (journal->fd < 0)
+    return -1;
+
+  count = writeSnapshot(journal, generation);
+  if (count < 0)
+    return -1;
+  deleteJournals(journal, generation);
+
+  journal->recoveredGames = count;
+  journal->recoveryNs = metricsNow() - start;
+
+  journal->buffers[0] = (char *)malloc(JOURNAL_BUFFER_SIZE);
+  journal->buffers[1] = (char *)malloc(JOURNAL_BUFFER_SIZE);
+  if (journal->buffers[0] == NULL || journal->buffers[1] == NULL)
+    return -1;
+
+  journal->used = 0;
+  journal->active = 0;
+  journal->nextLsn = 1;
+  journal->durableLsn = 0;
+  journal->sinceSnapshot = 0;
+  journal->rotate = FALSE;
+  journal->failed = FALSE;
+
+  pthread_mutex_init(&(journal->mutex), NULL);
+  pthread_cond_init(&(journal->pending), NULL);
+  pthread_cond_init(&(journal->flushed), NULL);
+  pthread_cond_init(&(journal->snapshot), NULL);
+
+  if (pthread_create(&(journal->writer), NULL, writerThread, journal) != 0 ||
+      pthread_create(&(journal->snapshotter), NULL, snapshotThread, journal) !=
+          0)
+    return -1;
+
+  journal->enabled = TRUE;
+  return 0;
+}
+
+uint64_t appendJournal(tJournal *journal, tGame *game, tJournalEvent event) {
+
+  tJournalRecord record;
+  uint64_t lsn;
+
+  if (!journal->enabled)
+    return 0;
+
+  // La imagen se copia fuera del mutex del journal (ya se tiene el del juego)
+  record.magic = JOURNAL_MAGIC;
+  record.event = event;
+  record.reserved = 0;
+  saveImage(&(record.image), game);
+
+  metricsLock(&journal->mutex);
+
+  // Buffer lleno: esperar a que el escritor lo cambie por el otro, sin el
+  // mutex del juego. Al recuperarlo se copia su imagen mas reciente
+  while (!journal->failed &&
+         journal->used + sizeof(tJournalRecord) > JOURNAL_BUFFER_SIZE) {
+    pthread_mutex_unlock(&game->mutex);
+    pthread_cond_wait(&journal->flushed, &journal->mutex);
+    pthread_mutex_unlock(&journal->mutex);
+
+    metricsLock(&game->mutex);
+    saveImage(&(record.image), game);
+    metricsLock(&journal->mutex);
+  }
+
+  // El escritor ya no escribe: no se guarda nada mas
+  if (journal->failed) {
+    pthread_mutex_unlock(&journal->mutex);
+    return JOURNAL_FAILED;
+  }
+
+  lsn = journal->nextLsn++;
+  record.lsn = lsn;
+  record.checksum = recordChecksum(&record);
+  memcpy(journal->buffers[journal->active] + journal->used, &record,
+         sizeof(record));
+  journal->used += sizeof(record);
+
+  pthread_cond_signal(&journal->pending);
+  pthread_mutex_unlock(&journal->mutex);
+
+  return lsn;
+}
+
+int waitJournal(tJournal *journal, uint64_t lsn) {
+
+  int error;
+
+  if (lsn == 0 ||
+      __atomic_load_n(&(journal->durableLsn), __ATOMIC_ACQUIRE) >= lsn)
+    return 0;
+
+  metricsLock(&journal->mutex);
+  while (journal->durableLsn < lsn && !journal->failed)
+    pthread_cond_wait(&journal->flushed, &journal->mutex);
+  error = (journal->durableLsn < lsn) ? -1 : 0;
+  pthread_mutex_unlock(&journal->mutex);
+
+  return error;
+}
@@ -0,0 +1,181 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "server.h"
+#include "table.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/** Size of each of the two buffers of the journal */
+#define JOURNAL_BUFFER_SIZE (1024 * 1024)
+
+/** Records written between two snapshots (bounds the replay at startup) */
+#define JOURNAL_SNAPSHOT_RECORDS 65536
+
+/** Magic number of the records and of the snapshot */
+#define JOURNAL_MAGIC 0x424A4A31U
+
+/** Returned by appendJournal once the journal can no longer be written */
+#define JOURNAL_FAILED UINT64_MAX
+
+/** Name of the snapshot file in the journal directory */
+#define SNAPSHOT_FILE "snapshot"
+
+/** Events written to the journal */
+typedef enum {
+  journalRegister, /** Player1 seated, waiting for a rival */
+  journalDeal,     /** Player2 seated, initial cards dealt */
+  journalHit,      /** A player took a card */
+  journalStand,    /** A player stood */
+  journalEnd       /** The game ended and was reset */
+} tJournalEvent;
+
+/**
+ * State of a game after an event, without pointers nor sync primitives.
+ * Replaying an event just copies its image over the game, so the replay does
+ * not depend on the rules nor on the random numbers.
+ */
+typedef struct gameImage {
+
+  int32_t id;
+  int32_t status;
+  int32_t currentPlayer;
+  int32_t endOfGame;
+  int32_t player1Stood;
+  int32_t player2Stood;
+  tScore player1Score;
+  tScore player2Score;
+  uint32_t player1Bet;
+  uint32_t player1Stack;
+  uint32_t player1Nonce;
+  uint32_t player2Bet;
+  uint32_t player2Stack;
+  uint32_t player2Nonce;
+  tRng rng;
+  tHand player1Deck;
+  tHand player2Deck;
+  tHand gameDeck;
+  char player1Name[STRING_LENGTH];
+  char player2Name[STRING_LENGTH];
+} tGameImage;
+
+/**
+ * Record of the journal. The checksum covers everything after it, so a record
+ * torn by a crash ends the replay.
+ */
+typedef struct journalRecord {
+
+  uint32_t magic;    /** JOURNAL_MAGIC */
+  uint32_t checksum; /** Checksum of the rest of the record */
+  uint64_t lsn;      /** Sequence number of the record */
+  uint32_t event;    /** Event (tJournalEvent) */
+  uint32_t reserved;
+  tGameImage image;  /** Game after the event */
+} tJournalRecord;
+
+/**
+ * Header of a snapshot, followed by count images (non-empty games only)
+ */
+typedef struct snapshotHeader {
+
+  uint32_t magic;      /** JOURNAL_MAGIC */
+  uint32_t imageSize;  /** sizeof(tGameImage) when it was written */
+  uint64_t generation; /** First journal to be replayed after it */
+  uint64_t count;      /** Number of images */
+} tSnapshotHeader;
+
+/**
+ * Append-only journal of game events, with group commit. Workers copy their
+ * records to the active buffer; the writer thread swaps the buffers and
+ * writes the whole batch with one write and one fdatasync, so the records
+ * that arrive during an fdatasync share the next one. A snapshot thread
+ * rotates the journal every JOURNAL_SNAPSHOT_RECORDS records and dumps the
+ * table, so the old journal can be deleted.
+ *
+ * Files of the directory: SNAPSHOT_FILE and journal.<generation>. The
+ * snapshot names the first generation to be replayed after it.
+ */
+typedef struct journal {
+
+  int enabled;         /** FALSE if the server runs without a journal */
+  char dir[256];       /** Directory of the files */
+  tGameTable *table;   /** Games dumped in the snapshots */
+  int fd;              /** Current journal file (only used by the writer) */
+  uint64_t generation; /** Generation of the current journal file */
+  uint64_t oldest;     /** Oldest journal file not deleted yet */
+
+  pthread_mutex_t mutex;
+  pthread_cond_t pending;  /** Signaled when there is something to write */
+  pthread_cond_t flushed;  /** Signaled after each write (and rotation) */
+  pthread_cond_t snapshot; /** Signaled when a snapshot is due */
+  char *buffers[2];        /** Active buffer and buffer being written */
+  size_t used;             /** Bytes in the active buffer */
+  int active;              /** Index of the active buffer */
+  uint64_t nextLsn;        /** Sequence number of the next record */
+  uint64_t durableLsn;     /** Last record on disk */
+  int sinceSnapshot;       /** Records written since the last snapshot */
+  int rotate;              /** TRUE if the snapshot thread asked to rotate */
+  int failed;              /** TRUE once a write has failed (see waitJournal) */
+
+  pthread_t writer;
+  pthread_t snapshotter;
+
+  int recoveredGames;            /** Games restored at startup */
+  int replayedRecords;           /** Records replayed at startup */
+  unsigned long long recoveryNs; /** Time of the recovery at startup (ns) */
+} tJournal;
+
+/**
+ * Recovers the games of a journal directory and starts journaling. The latest
+ * snapshot is mapped and loaded into the table, then the journal files after
+ * it are replayed up to the first torn record. A new snapshot is written
+ * before returning, so the old files are deleted and the next recovery only
+ * replays what comes after it.
+ *
+ * The table must be empty: games are allocated with their original ids. The
+ * caller rebuilds the rest of the server state (names, matchmaking) from the
+ * games of the table.
+ *
+ * @param journal Journal to be initialized.
+ * @param dir Directory of the files (created if it does not exist).
+ * @param table Game table.
+ * @return 0 on success, -1 on error.
+ */
+int openJournal(tJournal *journal, const char *dir, tGameTable *table);
+
+/**
+ * Writes an event of a game to the journal (in memory: see waitJournal). The
+ * game mutex must be held, so the records of a game are in order.
+ *
+ * If both buffers are full (a slow fdatasync), the game mutex is released
+ * while waiting for space, so the other calls of the game do not wait for the
+ * disk. The image is copied again once the game is locked back: it is the
+ * latest state of the game, which covers the event. Callers must not rely on
+ * the game being unchanged across this call.
+ *
+ * @param journal Journal.
+ * @param game Game, already updated by the event.
+ * @param event Event.
+ * @return Sequence number of the record, 0 if there is no journal, or
+ * JOURNAL_FAILED if the journal can no longer be written.
+ */
+uint64_t appendJournal(tJournal *journal, tGame *game, tJournalEvent event);
+
+/**
+ * Waits until a record is on disk. Must be called without holding any game
+ * mutex.
+ *
+ * A failed write or fdatasync is not retried: after a failed fdatasync the
+ * kernel may have dropped the pages, so nothing written after the last good
+ * one can be trusted. The journal stays failed, and every record not yet on
+ * disk is reported as lost, so the call that made it fails instead of being
+ * confirmed.
+ *
+ * @param journal Journal.
+ * @param lsn Sequence number of the record (0: nothing to wait for).
+ * @return 0 when the record is on disk, or -1 if the journal failed before
+ * writing it.
+ */
+int waitJournal(tJournal *journal, uint64_t lsn);
+
+#endif
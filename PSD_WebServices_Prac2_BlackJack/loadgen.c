@@ -0,0 +1,365 @@
+#include "loadgen.h"
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Set when the benchmark ends: the players finish their game and stop */
+volatile int stopBench = FALSE;
+
+/** Number of players still running */
+int activeBots = 0;
+
+/** End of the measured window: later calls are not counted */
+unsigned long long benchEnd;
+
+/** Configuration of the benchmark */
+tBenchConfig config;
+
+static const char *rpcNames[NUM_RPCS] = {"register", "getStatus",
+                                         "playerMove"};
+
+static unsigned long long nowMicros() {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/**
+ * Stores the latency of a call (or counts the error), if it ended inside the
+ * measured window.
+ */
+static void record(tBot *bot, tRpc rpc, int error, unsigned long long start) {
+
+  tSamples *samples = &(bot->samples[rpc]);
+  unsigned long long end = nowMicros();
+  unsigned int *latencies;
+  int capacity;
+
+  if (end > benchEnd)
+    return;
+
+  pthread_mutex_lock(&(bot->mutex));
+
+  if (error != SOAP_OK) {
+    samples->errors++;
+  } else if (samples->count < samples->capacity) {
+    samples->latencies[samples->count++] = end - start;
+  } else {
+    capacity = 2 * (samples->capacity + 64);
+    latencies = (unsigned int *)realloc(samples->latencies,
+                                        capacity * sizeof(unsigned int));
+    if (latencies != NULL) {
+      samples->latencies = latencies;
+      samples->capacity = capacity;
+      samples->latencies[samples->count++] = end - start;
+    }
+  }
+
+  pthread_mutex_unlock(&(bot->mutex));
+}
+
+/**
+ * Counts a finished game, if it ended inside the measured window.
+ */
+static void recordGame(tBot *bot, int *counter) {
+
+  if (nowMicros() > benchEnd)
+    return;
+
+  pthread_mutex_lock(&(bot->mutex));
+  (*counter)++;
+  pthread_mutex_unlock(&(bot->mutex));
+}
+
+/**
+ * Points of a hand (same rules as the server, softPoints included).
+ */
+static unsigned int handPoints(blackJackns__tDeck *deck) {
+
+  unsigned int points = 0, card;
+  int aces = 0;
+
+  for (int i = 0; i < deck->__size; i++) {
+    card = deck->cards[i] % SUIT_SIZE;
+    points += (card < 9) ? card + 1 : 10;
+    if (card == 0)
+      aces++;
+  }
+
+  // Un as vale 11 si con eso no se pasa
+  if (aces > 0 && points + HAND_SOFT_ACE_BONUS <= HAND_GOAL)
+    points += HAND_SOFT_ACE_BONUS;
+
+  return points;
+}
+
+/**
+ * Plays one game until its end is reported (or the player is lost).
+ */
+static void playGame(tBot *bot, struct soap *soap,
+                     blackJackns__tMessage playerName, int gameId) {
+
+  blackJackns__tBlock status;
+  unsigned long long start;
+  int error, action;
+
+  while (TRUE) {
+
+    start = nowMicros();
+    error = soap_call_blackJackns__getStatus(soap, config.serverURL, "",
+                                             playerName, gameId, &status);
+    record(bot, rpcGetStatus, error, start);
+
+    if (error != SOAP_OK)
+      return;
+
+    // Fin de la partida (solo se le comunica a uno de los dos)
+    if (status.code == GAME_WIN || status.code == GAME_LOSE) {
+      recordGame(bot, &(bot->games));
+      return;
+    }
+
+    if (status.code != TURN_PLAY) {
+      recordGame(bot, &(bot->notFound));
+      return;
+    }
+
+    // Turno: pedir cartas mientras la estrategia lo diga
+    while (status.code == TURN_PLAY) {
+
+      action = (handPoints(&(status.deck)) < config.standOn) ? PLAYER_HIT_CARD
+                                                              : PLAYER_STAND;
+
+      start = nowMicros();
+      error = soap_call_blackJackns__playerMove(
+          soap, config.serverURL, "", playerName, gameId, action, &status);
+      record(bot, rpcPlayerMove, error, start);
+
+      if (error != SOAP_OK)
+        return;
+    }
+
+    // Se ha pasado o se han plantado los dos
+    if (status.code == GAME_WIN || status.code == GAME_LOSE)
+      return;
+
+    soap_end(soap);
+  }
+}
+
+static void *botThread(void *arg) {
+
+  tBot *bot = (tBot *)arg;
+  struct soap soap;
+  blackJackns__tMessage playerName;
+  char name[STRING_LENGTH];
+  unsigned long long start;
+  int error, result, round = 0;
+
+  soap_init(&soap);
+  soap.send_timeout = 60;
+  soap.recv_timeout = 60;
+
+  playerName.msg = name;
+
+  while (!stopBench) {
+
+    // Un nombre distinto en cada partida
+    playerName.__size = snprintf(name, STRING_LENGTH, "bot%d_%d", bot->index,
+                                 round++);
+
+    start = nowMicros();
+    error = soap_call_blackJackns__register(&soap, config.serverURL, "",
+                                            playerName, &result);
+    record(bot, rpcRegister, error, start);
+
+    if (error == SOAP_OK && result >= 0)
+      playGame(bot, &soap, playerName, result);
+    else
+      usleep(100000);
+
+    soap_destroy(&soap);
+    soap_end(&soap);
+  }
+
+  soap_done(&soap);
+  __atomic_sub_fetch(&activeBots, 1, __ATOMIC_SEQ_CST);
+  return NULL;
+}
+
+static int compareLatencies(const void *a, const void *b) {
+
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+  return (x > y) - (x < y);
+}
+
+static unsigned int percentile(unsigned int *latencies, int count, double p) {
+
+  int index = (int)(p * count + 0.999999) - 1;
+
+  if (count == 0)
+    return 0;
+
+  return latencies[(index < 0) ? 0 : index];
+}
+
+/**
+ * Prints the throughput and the latency percentiles of each RPC, over the
+ * measured window (elapsed seconds). The samples of each player are read with
+ * its mutex held: some players may still be waiting for a response.
+ */
+static void printReport(tBot *bots, double elapsed) {
+
+  unsigned int *latencies;
+  long long totalCalls = 0;
+  int count, errors, games = 0, notFound = 0;
+
+  printf("\n%-11s %10s %10s %9s %9s %9s %9s %7s\n", "RPC", "calls",
+         "calls/s", "p50(us)", "p99(us)", "p999(us)", "max(us)", "errors");
+
+  for (int rpc = 0; rpc < NUM_RPCS; rpc++) {
+
+    count = 0;
+    for (int i = 0; i < config.numPlayers; i++)
+      count += bots[i].samples[rpc].count;
+
+    // Todas las latencias juntas, ordenadas (ya no crecen: fuera de la
+    // ventana no se anade nada)
+    latencies = (unsigned int *)malloc((count + 1) * sizeof(unsigned int));
+    count = 0;
+    errors = 0;
+    for (int i = 0; i < config.numPlayers; i++) {
+      pthread_mutex_lock(&(bots[i].mutex));
+      memcpy(latencies + count, bots[i].samples[rpc].latencies,
+             bots[i].samples[rpc].count * sizeof(unsigned int));
+      count += bots[i].samples[rpc].count;
+      errors += bots[i].samples[rpc].errors;
+      pthread_mutex_unlock(&(bots[i].mutex));
+    }
+    qsort(latencies, count, sizeof(unsigned int), compareLatencies);
+
+    printf("%-11s %10d %10.0f %9u %9u %9u %9u %7d\n", rpcNames[rpc], count,
+           count / elapsed, percentile(latencies, count, 0.50),
+           percentile(latencies, count, 0.99),
+           percentile(latencies, count, 0.999),
+           percentile(latencies, count, 1.0), errors);
+
+    totalCalls += count;
+    free(latencies);
+  }
+
+  for (int i = 0; i < config.numPlayers; i++) {
+    pthread_mutex_lock(&(bots[i].mutex));
+    games += bots[i].games;
+    notFound += bots[i].notFound;
+    pthread_mutex_unlock(&(bots[i].mutex));
+  }
+
+  printf("\nElapsed: %.2f s, %d players\n", elapsed, config.numPlayers);
+  printf("Throughput: %.0f RPC/s\n", totalCalls / elapsed);
+  printf("Games completed: %d (%.1f games/s)\n", games, games / elapsed);
+  if (notFound > 0)
+    printf("Player not found: %d\n", notFound);
+}
+
+static void printUsage(const char *program) {
+  printf("Usage: %s [--players n] [--duration s] [--stand-on points] "
+         "http://server:port\n",
+         program);
+}
+
+int main(int argc, char **argv) {
+
+  tBot *bots;
+  pthread_attr_t attr;
+  unsigned long long now;
+  int opt, waited;
+
+  static struct option longOptions[] = {
+      {"players", required_argument, NULL, 'p'},
+      {"duration", required_argument, NULL, 'd'},
+      {"stand-on", required_argument, NULL, 's'},
+      {NULL, 0, NULL, 0}};
+
+  config.numPlayers = DEFAULT_PLAYERS;
+  config.duration = DEFAULT_DURATION;
+  config.standOn = DEFAULT_STAND_ON;
+
+  // Check arguments
+  while ((opt = getopt_long(argc, argv, "p:d:s:", longOptions, NULL)) != -1) {
+    switch (opt) {
+    case 'p':
+      config.numPlayers = atoi(optarg);
+      break;
+    case 'd':
+      config.duration = atoi(optarg);
+      break;
+    case 's':
+      config.standOn = atoi(optarg);
+      break;
+    default:
+      printUsage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (optind != argc - 1 || config.numPlayers <= 0 || config.duration <= 0) {
+    printUsage(argv[0]);
+    exit(0);
+  }
+
+  config.serverURL = argv[optind];
+
+  bots = (tBot *)calloc(config.numPlayers, sizeof(tBot));
+  if (bots == NULL) {
+    printf("Error allocating the players!\n");
+    exit(1);
+  }
+
+  // Miles de hilos: pila pequena
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, PLAYER_STACK_SIZE);
+
+  printf("Benchmark: %d players against %s for %d s (stand on %d)\n",
+         config.numPlayers, config.serverURL, config.duration, config.standOn);
+
+  // Solo se mide la duracion pedida, no el arranque de los hilos ni la espera
+  // final
+  benchEnd = nowMicros() + config.duration * 1000000ULL;
+
+  for (int i = 0; i < config.numPlayers; i++) {
+    bots[i].index = i;
+    pthread_mutex_init(&(bots[i].mutex), NULL);
+    __atomic_add_fetch(&activeBots, 1, __ATOMIC_SEQ_CST);
+
+    if (pthread_create(&(bots[i].thread), &attr, botThread, &bots[i]) != 0) {
+      __atomic_sub_fetch(&activeBots, 1, __ATOMIC_SEQ_CST);
+      printf("Error creating player %d!\n", i);
+      config.numPlayers = i;
+      break;
+    }
+  }
+
+  while ((now = nowMicros()) < benchEnd)
+    usleep((benchEnd - now < 100000) ? benchEnd - now : 100000);
+  stopBench = TRUE;
+
+  // Esperar a que acaben las partidas en curso (un jugador sin rival se queda
+  // esperando, no se espera por el)
+  for (waited = 0; waited < GRACE_PERIOD * 10 &&
+                   __atomic_load_n(&activeBots, __ATOMIC_SEQ_CST) > 0;
+       waited++)
+    usleep(100000);
+
+  // Si han terminado todos se recogen; los que siguen esperando una respuesta
+  // ya no anaden muestras (record)
+  if (__atomic_load_n(&activeBots, __ATOMIC_SEQ_CST) == 0)
+    for (int i = 0; i < config.numPlayers; i++)
+      pthread_join(bots[i].thread, NULL);
+
+  printReport(bots, config.duration);
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include "blackJackns.nsmap"
+#include "soapH.h"
+#include <pthread.h>
+
+/** Default number of simulated players */
+#define DEFAULT_PLAYERS 1000
+
+/** Default duration of the benchmark (in seconds) */
+#define DEFAULT_DURATION 30
+
+/** Default strategy: hit while the points are below this value */
+#define DEFAULT_STAND_ON 17
+
+/** Seconds to wait for the games in progress once the benchmark ends */
+#define GRACE_PERIOD 10
+
+/** Stack size of each simulated player */
+#define PLAYER_STACK_SIZE (256 * 1024)
+
+/** Points that must not be exceeded (GOAL_GAME in the server) */
+#define HAND_GOAL 21
+
+/** Extra points of an ace that counts 11 (SOFT_ACE_BONUS in the server) */
+#define HAND_SOFT_ACE_BONUS 10
+
+/** RPCs measured by the benchmark */
+typedef enum { rpcRegister, rpcGetStatus, rpcPlayerMove, NUM_RPCS } tRpc;
+
+/**
+ * Latencies (in microseconds) measured by one player for one RPC
+ */
+typedef struct samples {
+
+  unsigned int *latencies; /** Latency of each call */
+  int count;               /** Number of calls */
+  int capacity;            /** Size of latencies */
+  int errors;              /** Calls that failed (SOAP errors) */
+} tSamples;
+
+/**
+ * Simulated player: plays games in a loop until the benchmark ends
+ */
+typedef struct bot {
+
+  int index;                  /** Index of the player */
+  pthread_t thread;           /** Thread running this player */
+  pthread_mutex_t mutex;      /** Protects the samples (read by the report) */
+  tSamples samples[NUM_RPCS]; /** Latencies of each RPC */
+  int games;                  /** Games finished through getStatus */
+  int notFound;               /** Times the server did not find the player */
+} tBot;
+
+/**
+ * Configuration of the benchmark
+ */
+typedef struct benchConfig {
+
+  char *serverURL; /** Server URL */
+  int numPlayers;  /** Number of simulated players */
+  int duration;    /** Duration (in seconds) */
+  int standOn;     /** The players hit while their points are below this */
+} tBenchConfig;
@@ -0,0 +1,175 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/** Current log level */
+static int logLevel = DEFAULT_LOG_LEVEL;
+
+static const char *levelNames[] = {"error", "warning", "info", "debug"};
+
+/** Per-thread rings (preallocated: logging never allocates) */
+static tLogRing rings[LOG_RINGS];
+
+/** Rings taken by a thread */
+static int numRings = 0;
+
+/** Records lost because there were no rings left */
+static unsigned int droppedNoRing = 0;
+
+/** Ring of the current thread */
+static __thread tLogRing *threadRing = NULL;
+
+static pthread_t flusher;
+
+void setLogLevel(tLogLevel level) {
+  __atomic_store_n(&logLevel, level, __ATOMIC_RELAXED);
+}
+
+tLogLevel getLogLevel() {
+  return __atomic_load_n(&logLevel, __ATOMIC_RELAXED);
+}
+
+int parseLogLevel(const char *name) {
+
+  for (int level = logError; level <= logDebug; level++)
+    if (strcmp(name, levelNames[level]) == 0)
+      return level;
+
+  return -1;
+}
+
+const char *logLevelName(tLogLevel level) {
+  return levelNames[level];
+}
+
+static tLogRing *getRing() {
+
+  int index;
+
+  // Primer uso en este hilo: coger un ring libre
+  if (threadRing == NULL) {
+    index = __atomic_fetch_add(&numRings, 1, __ATOMIC_RELAXED);
+    if (index >= LOG_RINGS)
+      return NULL;
+    threadRing = &rings[index];
+  }
+
+  return threadRing;
+}
+
+void logEvent(tLogLevel level, const char *format, const char *name, int arg0,
+              int arg1) {
+
+  tLogRing *ring;
+  tLogRecord *record;
+  struct timespec now;
+  unsigned int tail;
+
+  if (level > getLogLevel())
+    return;
+
+  ring = getRing();
+  if (ring == NULL) {
+    __atomic_fetch_add(&droppedNoRing, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  // Ring lleno: se pierde el registro, nunca se bloquea
+  tail = ring->tail;
+  if (tail - __atomic_load_n(&(ring->head), __ATOMIC_ACQUIRE) ==
+      LOG_RING_SIZE) {
+    __atomic_fetch_add(&(ring->dropped), 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  record = &(ring->records[tail % LOG_RING_SIZE]);
+  record->time = now.tv_sec * 1000000000ULL + now.tv_nsec;
+  record->format = format;
+  record->args[0] = arg0;
+  record->args[1] = arg1;
+  record->level = level;
+  record->hasName = (name != NULL);
+  if (name != NULL) {
+    strncpy(record->name, name, LOG_NAME_LENGTH - 1);
+    record->name[LOG_NAME_LENGTH - 1] = 0;
+  }
+
+  __atomic_store_n(&(ring->tail), tail + 1, __ATOMIC_RELEASE);
+}
+
+static void writeRecord(tLogRecord *record) {
+
+  time_t seconds = record->time / 1000000000ULL;
+  struct tm local;
+  char timestamp[16];
+
+  localtime_r(&seconds, &local);
+  strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &local);
+  printf("%s.%03llu %-7s ", timestamp, (record->time / 1000000) % 1000,
+         levelNames[record->level]);
+
+  if (record->hasName)
+    printf(record->format, record->name, record->args[0], record->args[1]);
+  else
+    printf(record->format, record->args[0], record->args[1]);
+
+  printf("\n");
+}
+
+/**
+ * Writes the queued records of all the rings. Only the flusher calls it.
+ */
+static void flushRings() {
+
+  static unsigned int reported = 0;
+  unsigned int head, tail, dropped = 0;
+  int count = __atomic_load_n(&numRings, __ATOMIC_RELAXED);
+
+  if (count > LOG_RINGS)
+    count = LOG_RINGS;
+
+  for (int i = 0; i < count; i++) {
+
+    head = rings[i].head;
+    tail = __atomic_load_n(&(rings[i].tail), __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+      writeRecord(&(rings[i].records[head % LOG_RING_SIZE]));
+
+    __atomic_store_n(&(rings[i].head), head, __ATOMIC_RELEASE);
+    dropped += __atomic_load_n(&(rings[i].dropped), __ATOMIC_RELAXED);
+  }
+
+  dropped += __atomic_load_n(&droppedNoRing, __ATOMIC_RELAXED);
+  if (dropped != reported) {
+    printf("[Logger] %u records dropped\n", dropped - reported);
+    reported = dropped;
+  }
+
+  fflush(stdout);
+}
+
+static void *flusherThread(void *arg) {
+
+  struct timespec interval = {0, LOG_FLUSH_INTERVAL * 1000000L};
+
+  while (1) {
+    flushRings();
+    nanosleep(&interval, NULL);
+  }
+
+  return NULL;
+}
+
+int initLogger(tLogLevel level) {
+
+  setLogLevel(level);
+
+  if (pthread_create(&flusher, NULL, flusherThread, NULL) != 0)
+    return -1;
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <pthread.h>
+
+/** Number of per-thread rings (threads beyond this drop their records) */
+#define LOG_RINGS 128
+
+/** Records in each ring (power of 2) */
+#define LOG_RING_SIZE 256
+
+/** Bytes of the name stored in a record */
+#define LOG_NAME_LENGTH 32
+
+/** Interval between flushes (in milliseconds) */
+#define LOG_FLUSH_INTERVAL 10
+
+/** Default log level */
+#define DEFAULT_LOG_LEVEL logInfo
+
+/** Path of the log level: GET to read it, GET ?debug to change it (local) */
+#define LOG_LEVEL_PATH "/log-level"
+
+/** Log levels */
+typedef enum { logError, logWarning, logInfo, logDebug } tLogLevel;
+
+/**
+ * Compact log record. The text is only formatted by the flusher thread: the
+ * record keeps a pointer to the format (a string literal), the player name
+ * and two integer arguments.
+ */
+typedef struct logRecord {
+
+  unsigned long long time;    /** Wall clock time (ns) */
+  const char *format;         /** Format (string literal) */
+  int args[2];                /** Integer arguments */
+  unsigned char level;        /** Level of the record */
+  unsigned char hasName;      /** TRUE if the format starts with a %s */
+  char name[LOG_NAME_LENGTH]; /** Name (truncated) */
+} tLogRecord;
+
+/**
+ * Ring of records written by one thread and read by the flusher (single
+ * producer, single consumer, no locks).
+ */
+typedef struct logRing {
+
+  unsigned int head __attribute__((aligned(64))); /** Next record to flush */
+  unsigned int tail __attribute__((aligned(64))); /** Next free record */
+  unsigned int dropped;                            /** Records lost (full) */
+  tLogRecord records[LOG_RING_SIZE];
+} tLogRing;
+
+/**
+ * Sets the log level and starts the flusher thread.
+ *
+ * @param level Initial log level.
+ * @return 0 on success, -1 on error.
+ */
+int initLogger(tLogLevel level);
+
+/**
+ * Changes the log level (at runtime).
+ *
+ * @param level New log level.
+ */
+void setLogLevel(tLogLevel level);
+
+/**
+ * Gets the current log level.
+ *
+ * @return Current log level.
+ */
+tLogLevel getLogLevel();
+
+/**
+ * Parses the name of a log level (error, warning, info or debug).
+ *
+ * @param name Name of the level.
+ * @return The level, or -1 if the name is not valid.
+ */
+int parseLogLevel(const char *name);
+
+/**
+ * Gets the name of a log level.
+ *
+ * @param level Log level.
+ * @return Name of the level.
+ */
+const char *logLevelName(tLogLevel level);
+
+/**
+ * Queues a record in the ring of the calling thread. It never blocks nor
+ * allocates: if the ring is full, the record is dropped (and counted).
+ *
+ * @param level Level of the record (ignored if above the current level).
+ * @param format Format (string literal). If name is not NULL it is the first
+ * argument (%s), followed by arg0 and arg1 (%d).
+ * @param name Player name, or NULL.
+ * @param arg0 First integer argument.
+ * @param arg1 Second integer argument.
+ */
+void logEvent(tLogLevel level, const char *format, const char *name, int arg0,
+              int arg1);
+
+#endif
@@ -0,0 +1,118 @@
+#include "matchmaking.h"
+#include "metrics.h"
+#include "shared.h"
+
+void initMatchmaker(tMatchmaker *matchmaker, tGameTable *table) {
+
+  initSharedMutex(&(matchmaker->mutex));
+  matchmaker->waitingHead = NO_GAME;
+  matchmaker->waitingTail = NO_GAME;
+  matchmaker->freeList = NO_GAME;
+  matchmaker->table = table;
+  matchmaker->numWaiting = 0;
+  matchmaker->numPlaying = 0;
+}
+
+/**
+ * Adds a new chunk of the table to the free list. The matchmaker mutex must be
+ * held.
+ */
+static int growFreeList(tMatchmaker *matchmaker) {
+
+  tGame *chunk = growGameTable(matchmaker->table);
+
+  if (chunk == NULL)
+    return -1;
+
+  for (int i = TABLE_CHUNK_SIZE - 1; i >= 0; i--) {
+    chunk[i].next = matchmaker->freeList;
+    matchmaker->freeList = chunk[i].id;
+  }
+
+  return 0;
+}
+
+/**
+ * Appends a game to the waiting queue. The matchmaker mutex must be held.
+ */
+static void enqueueWaiting(tMatchmaker *matchmaker, tGame *game) {
+
+  game->next = NO_GAME;
+  if (matchmaker->waitingTail == NO_GAME)
+    matchmaker->waitingHead = game->id;
+  else
+    getGame(matchmaker->table, matchmaker->waitingTail)->next = game->id;
+  matchmaker->waitingTail = game->id;
+  matchmaker->numWaiting++;
+}
+
+int seatPlayer(tMatchmaker *matchmaker, tGame **game) {
+
+  tGame *candidate;
+  int seat;
+
+  metricsLock(&(matchmaker->mutex));
+
+  if (matchmaker->waitingHead != NO_GAME) {
+    // Hay un juego esperando: emparejar con el mas antiguo
+    candidate = getGame(matchmaker->table, matchmaker->waitingHead);
+    matchmaker->waitingHead = candidate->next;
+    if (matchmaker->waitingHead == NO_GAME)
+      matchmaker->waitingTail = NO_GAME;
+    matchmaker->numWaiting--;
+    matchmaker->numPlaying++;
+    seat = player2;
+  } else {
+    // No hay nadie esperando: sacar un juego vacio (se encola en queueGame)
+    if (matchmaker->freeList == NO_GAME && growFreeList(matchmaker) != 0) {
+      pthread_mutex_unlock(&(matchmaker->mutex));
+      return ERROR_SERVER_FULL;
+    }
+    candidate = getGame(matchmaker->table, matchmaker->freeList);
+    matchmaker->freeList = candidate->next;
+    seat = player1;
+  }
+
+  candidate->next = NO_GAME;
+  pthread_mutex_unlock(&(matchmaker->mutex));
+
+  // El juego se bloquea sin el mutex del matchmaker: ya no esta en ninguna
+  // lista, asi que nadie mas puede sentarse en el mientras tanto
+  metricsLock(&(candidate->mutex));
+
+  *game = candidate;
+  return seat;
+}
+
+void queueGame(tMatchmaker *matchmaker, tGame *game) {
+
+  metricsLock(&(matchmaker->mutex));
+  enqueueWaiting(matchmaker, game);
+  pthread_mutex_unlock(&(matchmaker->mutex));
+}
+
+void releaseGame(tMatchmaker *matchmaker, tGame *game) {
+
+  metricsLock(&(matchmaker->mutex));
+  game->next = matchmaker->freeList;
+  matchmaker->freeList = game->id;
+  matchmaker->numPlaying--;
+  pthread_mutex_unlock(&(matchmaker->mutex));
+}
+
+void restoreGame(tMatchmaker *matchmaker, tGame *game) {
+
+  metricsLock(&(matchmaker->mutex));
+
+  if (game->status == gameEmpty) {
+    game->next = matchmaker->freeList;
+    matchmaker->freeList = game->id;
+  } else if (game->status == gameWaitingPlayer) {
+    enqueueWaiting(matchmaker, game);
+  } else {
+    game->next = NO_GAME;
+    matchmaker->numPlaying++;
+  }
+
+  pthread_mutex_unlock(&(matchmaker->mutex));
+}
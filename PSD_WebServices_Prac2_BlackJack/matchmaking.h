@@ -0,0 +1,80 @@
+#ifndef MATCHMAKING_H
+#define MATCHMAKING_H
+
+#include "server.h"
+#include "table.h"
+#include <pthread.h>
+
+/**
+ * Matchmaking structure. A single lock protects a FIFO queue of half-filled
+ * games (one player waiting for a rival) and a free list of empty games. Both
+ * lists are linked through the field next of each game, so seating a player
+ * costs O(1) no matter how many games are active.
+ */
+typedef struct matchmaker {
+
+  pthread_mutex_t mutex;
+  int waitingHead;   /** Oldest game waiting for a second player */
+  int waitingTail;   /** Newest game waiting for a second player */
+  int freeList;      /** First empty game */
+  tGameTable *table; /** Table where the games live */
+  int numWaiting;    /** Games in the waiting queue (metrics) */
+  int numPlaying;    /** Games with two players (metrics) */
+} tMatchmaker;
+
+/**
+ * Initializes an empty matchmaker.
+ *
+ * @param matchmaker Matchmaker to be initialized.
+ * @param table Table where the games live.
+ */
+void initMatchmaker(tMatchmaker *matchmaker, tGameTable *table);
+
+/**
+ * Finds a seat for a new player. If there is a game waiting for a second
+ * player, it is taken out of the queue and the player is seated as player2.
+ * Otherwise, an empty game is taken from the free list (growing the table if
+ * needed) and the player is seated as player1; the caller queues it with
+ * queueGame once player1 is filled in.
+ *
+ * The matchmaker mutex is released before the game is locked, so a register
+ * never waits for a game while it blocks the others. The game taken is not in
+ * any list by then, so no one else can be seated in it. On success, the game
+ * is returned locked, so the caller can fill in the player before anyone else
+ * uses the game. Repeated names are rejected before calling this, by the name
+ * index (see names.h).
+ *
+ * @param matchmaker Matchmaker.
+ * @param game Game where the player is seated.
+ * @return The seat (player1 or player2), or ERROR_SERVER_FULL if the table is
+ * full.
+ */
+int seatPlayer(tMatchmaker *matchmaker, tGame **game);
+
+/**
+ * Puts a game with player1 already seated at the end of the waiting queue.
+ * Must be called without holding the game mutex.
+ *
+ * @param matchmaker Matchmaker.
+ * @param game Game waiting for a second player.
+ */
+void queueGame(tMatchmaker *matchmaker, tGame *game);
+
+/**
+ * Gives back an empty game (already reset with initGame) to the free list.
+ *
+ * @param matchmaker Matchmaker.
+ * @param game Empty game.
+ */
+void releaseGame(tMatchmaker *matchmaker, tGame *game);
+
+/**
+ * Puts a game restored from the journal in the list of its state: the waiting
+ * queue, the free list, or none (two players).
+ *
+ * @param matchmaker Matchmaker.
+ * @param game Restored game.
+ */
+void restoreGame(tMatchmaker *matchmaker, tGame *game);
+
+#endif
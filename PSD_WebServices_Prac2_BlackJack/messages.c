@@ -0,0 +1,61 @@
+#include "messages.h"
+
+/** Templates, indexed by tMessageId */
+static const char *templates[MSG_NUM_TEMPLATES] = {
+    [MSG_TEXT] = "",
+    [MSG_LOSE_OVER] = "You lose! You went over %d points. Your points: %d, "
+                      "Rival points: %d",
+    [MSG_WIN_RIVAL_OVER] = "You win! Rival went over %d points. Your points: "
+                           "%d, Rival points: %d",
+    [MSG_WIN] = "You win! Your points: %d, Rival points: %d",
+    [MSG_LOSE] = "You lose! Your points: %d, Rival points: %d",
+    [MSG_DRAW] = "Draw! Your points: %d, Rival points: %d",
+    [MSG_YOUR_TURN] = "Your turn! Your points: %d",
+    [MSG_NOT_YOUR_TURN] = "It's not your turn!",
+    [MSG_BUST] = "You went over %d! You lose. Your points: %d",
+    [MSG_REACHED_GOAL] = "You reached %d! You must stand. Your points: %d",
+    [MSG_DREW_CARD] = "You drew a card. Your points: %d",
+    [MSG_STAND] = "You stand with %d points. Rival's turn now.",
+    [MSG_INVALID_GAME] = "Invalid game ID",
+    [MSG_PLAYER_NOT_FOUND] = "Player not found"};
+
+int isPackedMessage(blackJackns__tMessage *message) {
+  return message->__size == MSG_PACKED_SIZE && message->msg != NULL &&
+         message->msg[0] == MSG_MARKER;
+}
+
+void packMessage(blackJackns__tMessage *message, int id, int arg0, int arg1,
+                 int arg2) {
+
+  // Los argumentos (puntos) caben en un byte
+  message->msg[0] = MSG_MARKER;
+  message->msg[1] = id;
+  message->msg[2] = arg0;
+  message->msg[3] = arg1;
+  message->msg[4] = arg2;
+  message->__size = MSG_PACKED_SIZE;
+}
+
+void formatMessage(blackJackns__tMessage *message, int id, int arg0, int arg1,
+                   int arg2) {
+
+  if (id < 0 || id >= MSG_NUM_TEMPLATES)
+    id = MSG_TEXT;
+
+  // Los argumentos que el template no usa se ignoran
+  message->__size =
+      snprintf(message->msg, STRING_LENGTH, templates[id], arg0, arg1, arg2);
+}
+
+void renderMessage(struct soap *soap, blackJackns__tMessage *message) {
+
+  blackJackns__tMessage packed = *message;
+
+  if (!isPackedMessage(message))
+    return;
+
+  message->msg = (xsd__string)soap_malloc(soap, STRING_LENGTH);
+  formatMessage(message, (unsigned char)packed.msg[1],
+                (signed char)packed.msg[2], (signed char)packed.msg[3],
+                (signed char)packed.msg[4]);
+}
@@ -0,0 +1,85 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include "soapH.h"
+
+/*
+ * Catalog of the messages sent by the server. A client that opts in receives
+ * only the id of the template and its arguments (packed in the message), and
+ * renders the text locally.
+ */
+
+/** Path of the SOAP endpoint that answers with message codes (opt in) */
+#define MSG_CODES_PATH "/codes"
+
+/** First byte of a packed message (a text never starts with \0) */
+#define MSG_MARKER 0
+
+/** Maximum number of arguments of a template */
+#define MSG_MAX_ARGS 3
+
+/** Size of a packed message: marker, id and arguments */
+#define MSG_PACKED_SIZE (2 + MSG_MAX_ARGS)
+
+/** Ids of the templates */
+typedef enum {
+  MSG_TEXT,             /** Not a template: the message is plain text */
+  MSG_LOSE_OVER,        /** Player went over the goal (goal, points, rival) */
+  MSG_WIN_RIVAL_OVER,   /** Rival went over the goal (goal, points, rival) */
+  MSG_WIN,              /** Player wins (points, rival) */
+  MSG_LOSE,             /** Player loses (points, rival) */
+  MSG_DRAW,             /** Draw (points, rival) */
+  MSG_YOUR_TURN,        /** Player's turn (points) */
+  MSG_NOT_YOUR_TURN,    /** Move out of turn */
+  MSG_BUST,             /** Hit over the goal (goal, points) */
+  MSG_REACHED_GOAL,     /** Hit up to the goal (goal, points) */
+  MSG_DREW_CARD,        /** Hit below the goal (points) */
+  MSG_STAND,            /** Player stands (points) */
+  MSG_INVALID_GAME,     /** Wrong game id */
+  MSG_PLAYER_NOT_FOUND, /** Player not registered in the game */
+  MSG_NUM_TEMPLATES
+} tMessageId;
+
+/**
+ * Checks if a message is packed (id and arguments) instead of text.
+ *
+ * @param message Message.
+ * @return TRUE if the message is packed.
+ */
+int isPackedMessage(blackJackns__tMessage *message);
+
+/**
+ * Packs a template id and its arguments in a message. The message buffer must
+ * have at least MSG_PACKED_SIZE bytes.
+ *
+ * @param message Message where the template is packed.
+ * @param id Id of the template.
+ * @param arg0 First argument.
+ * @param arg1 Second argument.
+ * @param arg2 Third argument.
+ */
+void packMessage(blackJackns__tMessage *message, int id, int arg0, int arg1,
+                 int arg2);
+
+/**
+ * Writes the text of a template in a message. The message buffer must have
+ * STRING_LENGTH bytes.
+ *
+ * @param message Message where the text is written.
+ * @param id Id of the template.
+ * @param arg0 First argument.
+ * @param arg1 Second argument.
+ * @param arg2 Third argument.
+ */
+void formatMessage(blackJackns__tMessage *message, int id, int arg0, int arg1,
+                   int arg2);
+
+/**
+ * Replaces a packed message with its text (plain texts are left as they are).
+ *
+ * @param soap Soap context (to allocate the text).
+ * @param message Received message.
+ */
+void renderMessage(struct soap *soap, blackJackns__tMessage *message);
+
+#endif
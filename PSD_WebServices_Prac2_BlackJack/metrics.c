@@ -0,0 +1,170 @@
+#include "metrics.h"
+#include "shared.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+
+/** Upper bounds of the histogram buckets (in microseconds) */
+static const unsigned long long bucketBounds[METRICS_BUCKETS] = {
+    100,   250,    500,    1000,   2500,    5000,    10000,   25000,
+    50000, 100000, 250000, 500000, 1000000, 2500000, 10000000};
+
+static const char *rpcNames[METRICS_RPCS] = {"register", "getStatus",
+                                             "playerMove"};
+
+/** Per-thread slots */
+static tMetricsSlot slots[METRICS_SLOTS];
+
+/** Next free slot */
+static int nextSlot = 0;
+
+/** Slot of the current thread */
+static __thread tMetricsSlot *threadSlot = NULL;
+
+static tMetricsSlot *getSlot() {
+
+  // Primer uso en este hilo: coger un slot
+  if (threadSlot == NULL)
+    threadSlot = &slots[__atomic_fetch_add(&nextSlot, 1, __ATOMIC_RELAXED) %
+                        METRICS_SLOTS];
+
+  return threadSlot;
+}
+
+/**
+ * Adds to a counter. Relaxed atomic: no lock, and the slot is only shared
+ * when there are more threads than slots.
+ */
+static void add(unsigned long long *counter, unsigned long long value) {
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static unsigned long long load(unsigned long long *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+unsigned long long metricsNow() {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void metricsRecordRpc(tMetricsRpc rpc, unsigned long long start) {
+
+  tMetricsSlot *slot = getSlot();
+  unsigned long long latency = (metricsNow() - start) / 1000;
+  int bucket = 0;
+
+  while (bucket < METRICS_BUCKETS && latency > bucketBounds[bucket])
+    bucket++;
+
+  add(&(slot->calls[rpc]), 1);
+  add(&(slot->latencySum[rpc]), latency);
+  add(&(slot->buckets[rpc][bucket]), 1);
+}
+
+void metricsLock(pthread_mutex_t *mutex) {
+
+  unsigned long long start;
+  tMetricsSlot *slot;
+  int error = pthread_mutex_trylock(mutex);
+
+  // Sin contencion no se mide nada
+  if (error != EBUSY) {
+    checkSharedLock(error);
+    return;
+  }
+
+  start = metricsNow();
+
+  // Mutex robusto (--shared) cuyo dueno murio: no se sigue (checkSharedLock)
+  checkSharedLock(pthread_mutex_lock(mutex));
+
+  slot = getSlot();
+  add(&(slot->lockWaits), 1);
+  add(&(slot->lockWaitSum), metricsNow() - start);
+}
+
+/**
+ * Formats a line of the response and sends it.
+ */
+static int sendLine(struct soap *soap, const char *format, ...) {
+
+  char line[STRING_LENGTH];
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(line, STRING_LENGTH, format, args);
+  va_end(args);
+
+  return soap_send(soap, line);
+}
+
+int sendMetrics(struct soap *soap, tMetricsGauges *gauges) {
+
+  unsigned long long calls, sum, count, lockWaits = 0, lockWaitSum = 0;
+  unsigned long long buckets[METRICS_BUCKETS + 1];
+  int rpc, i, bucket;
+
+  soap->http_content = "text/plain; version=0.0.4";
+  if (soap_response(soap, SOAP_FILE))
+    return soap->error;
+
+  sendLine(soap, "# TYPE blackjack_rpc_latency_seconds histogram\n");
+
+  for (rpc = 0; rpc < METRICS_RPCS; rpc++) {
+
+    // Sumar los slots de todos los hilos
+    calls = 0;
+    sum = 0;
+    memset(buckets, 0, sizeof(buckets));
+
+    for (i = 0; i < METRICS_SLOTS; i++) {
+      calls += load(&(slots[i].calls[rpc]));
+      sum += load(&(slots[i].latencySum[rpc]));
+      for (bucket = 0; bucket <= METRICS_BUCKETS; bucket++)
+        buckets[bucket] += load(&(slots[i].buckets[rpc][bucket]));
+    }
+
+    // Prometheus: los buckets son acumulados
+    count = 0;
+    for (bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+      count += buckets[bucket];
+      sendLine(soap,
+               "blackjack_rpc_latency_seconds_bucket{rpc=\"%s\",le=\"%g\"} "
+               "%llu\n",
+               rpcNames[rpc], bucketBounds[bucket] / 1e6, count);
+    }
+    count += buckets[METRICS_BUCKETS];
+    sendLine(soap,
+             "blackjack_rpc_latency_seconds_bucket{rpc=\"%s\",le=\"+Inf\"} "
+             "%llu\n",
+             rpcNames[rpc], count);
+    sendLine(soap, "blackjack_rpc_latency_seconds_sum{rpc=\"%s\"} %g\n",
+             rpcNames[rpc], sum / 1e6);
+    sendLine(soap, "blackjack_rpc_latency_seconds_count{rpc=\"%s\"} %llu\n",
+             rpcNames[rpc], calls);
+  }
+
+  for (i = 0; i < METRICS_SLOTS; i++) {
+    lockWaits += load(&(slots[i].lockWaits));
+    lockWaitSum += load(&(slots[i].lockWaitSum));
+  }
+
+  sendLine(soap, "# TYPE blackjack_lock_waits_total counter\n");
+  sendLine(soap, "blackjack_lock_waits_total %llu\n", lockWaits);
+  sendLine(soap, "# TYPE blackjack_lock_wait_seconds_total counter\n");
+  sendLine(soap, "blackjack_lock_wait_seconds_total %g\n", lockWaitSum / 1e9);
+  sendLine(soap, "# TYPE blackjack_queue_depth gauge\n");
+  sendLine(soap, "blackjack_queue_depth %d\n", gauges->queueDepth);
+  sendLine(soap, "# TYPE blackjack_active_games gauge\n");
+  sendLine(soap, "blackjack_active_games %d\n", gauges->activeGames);
+  sendLine(soap, "# TYPE blackjack_waiting_players gauge\n");
+  sendLine(soap, "blackjack_waiting_players %d\n", gauges->waitingPlayers);
+  sendLine(soap, "# TYPE blackjack_recovery_seconds gauge\n");
+  sendLine(soap, "blackjack_recovery_seconds %g\n", gauges->recoverySeconds);
+
+  return soap_end_send(soap);
+}
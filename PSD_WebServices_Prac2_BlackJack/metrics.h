@@ -0,0 +1,86 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "soapH.h"
+#include <pthread.h>
+
+/** Path of the metrics endpoint (HTTP GET, Prometheus text format) */
+#define METRICS_PATH "/metrics"
+
+/** Number of per-thread slots (threads beyond this share slots) */
+#define METRICS_SLOTS 256
+
+/** Number of buckets of the latency histograms (+Inf not included) */
+#define METRICS_BUCKETS 15
+
+/** Size of a cache line */
+#define CACHE_LINE_SIZE 64
+
+/** Operations measured */
+typedef enum {
+  metricsRegister,
+  metricsGetStatus,
+  metricsPlayerMove,
+  METRICS_RPCS
+} tMetricsRpc;
+
+/**
+ * Counters written by one thread. Each slot is aligned to a cache line, so
+ * threads never write to the same line (no false sharing). The slots are only
+ * added up when the metrics are read.
+ */
+typedef struct metricsSlot {
+
+  unsigned long long calls[METRICS_RPCS];      /** Calls of each RPC */
+  unsigned long long latencySum[METRICS_RPCS]; /** Sum of latencies (us) */
+  unsigned long long buckets[METRICS_RPCS][METRICS_BUCKETS + 1];
+  unsigned long long lockWaits;   /** Contended lock acquisitions */
+  unsigned long long lockWaitSum; /** Time waiting for locks (ns) */
+} __attribute__((aligned(CACHE_LINE_SIZE))) tMetricsSlot;
+
+/**
+ * Values read from the server structures when the metrics are scraped
+ */
+typedef struct metricsGauges {
+
+  int queueDepth;         /** Jobs waiting in the worker pool */
+  int activeGames;        /** Games with two players */
+  int waitingPlayers;     /** Players waiting for a rival */
+  double recoverySeconds; /** Time to recover the journal at startup */
+} tMetricsGauges;
+
+/**
+ * Current time of the monotonic clock.
+ *
+ * @return Time in nanoseconds.
+ */
+unsigned long long metricsNow();
+
+/**
+ * Records a finished call in the slot of the calling thread.
+ *
+ * @param rpc Operation.
+ * @param start Time when the call started (metricsNow).
+ */
+void metricsRecordRpc(tMetricsRpc rpc, unsigned long long start);
+
+/**
+ * Locks a mutex. If it is already held, the time waiting for it is recorded.
+ * The result is checked with checkSharedLock: a process never goes on with a
+ * mutex whose owner died.
+ *
+ * @param mutex Mutex to be locked.
+ */
+void metricsLock(pthread_mutex_t *mutex);
+
+/**
+ * Sends all the metrics (slots added up, plus the gauges) as the response to
+ * an HTTP GET, in Prometheus text format.
+ *
+ * @param soap Soap context of the request.
+ * @param gauges Current values of the gauges.
+ * @return SOAP_OK or the soap error.
+ */
+int sendMetrics(struct soap *soap, tMetricsGauges *gauges);
+
+#endif
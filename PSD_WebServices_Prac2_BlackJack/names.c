@@ -0,0 +1,203 @@
+#include "names.h"
+#include "metrics.h"
+#include "shared.h"
+
+/** FNV-1a (64 bits) */
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t hashName(const char *name) {
+
+  uint64_t hash = FNV_OFFSET;
+
+  while (*name != 0) {
+    hash ^= (unsigned char)*name++;
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/**
+ * First slot of a hash in a stripe (the low bits already chose the stripe).
+ */
+static int homeSlot(tNameStripe *stripe, uint64_t hash) {
+  return (int)((hash / NAME_STRIPES) & (stripe->capacity - 1));
+}
+
+/**
+ * Slot of a name, or the empty slot where it would go. The stripe mutex must
+ * be held.
+ */
+static int findSlot(tNameStripe *stripe, uint64_t hash, const char *name) {
+
+  int mask = stripe->capacity - 1;
+  int slot = homeSlot(stripe, hash);
+
+  while (stripe->slots[slot].name != NULL &&
+         (stripe->slots[slot].hash != hash ||
+          strcmp(stripe->slots[slot].name, name) != 0))
+    slot = (slot + 1) & mask;
+
+  return slot;
+}
+
+/**
+ * Doubles the slots of a stripe. The stripe mutex must be held. The new slots
+ * come from the slab (so the index can be shared) and the old ones are not
+ * reused: all the slots ever taken add up to less than twice the current
+ * ones.
+ */
+static int growStripe(tNameIndex *index, tNameStripe *stripe) {
+
+  tNameSlot *old = stripe->slots;
+  int oldCapacity = stripe->capacity, slot;
+
+  stripe->slots = (tNameSlot *)slabAlloc(&(index->slab),
+                                         2 * oldCapacity * sizeof(tNameSlot));
+  if (stripe->slots == NULL) {
+    stripe->slots = old;
+    return -1;
+  }
+  stripe->capacity = 2 * oldCapacity;
+
+  // Reinsertar: no hay repetidos, basta con buscar un hueco
+  for (int i = 0; i < oldCapacity; i++) {
+    if (old[i].name == NULL)
+      continue;
+    slot = homeSlot(stripe, old[i].hash);
+    while (stripe->slots[slot].name != NULL)
+      slot = (slot + 1) & (stripe->capacity - 1);
+    stripe->slots[slot] = old[i];
+  }
+
+  return 0;
+}
+
+/**
+ * Gets a block for a copy of a name: a released one of the stripe, or a new
+ * one of the slab. The stripe mutex must be held.
+ */
+static char *allocName(tNameIndex *index, tNameStripe *stripe) {
+
+  char *block = stripe->freeNames;
+
+  if (block != NULL) {
+    stripe->freeNames = *(char **)block;
+    return block;
+  }
+
+  return (char *)slabAlloc(&(index->slab), STRING_LENGTH);
+}
+
+size_t nameIndexMemory(size_t maxNames) {
+
+  // Copias de los nombres y huecos de las franjas: contando los abandonados
+  // al crecer, unos 8 por nombre como mucho (si falta, addName lo indica)
+  size_t slotMemory =
+      8 * (maxNames + NAME_STRIPES * NAME_STRIPE_SLOTS) * sizeof(tNameSlot);
+
+  return (maxNames * STRING_LENGTH + slotMemory + SLAB_ALIGNMENT - 1) &
+         ~((size_t)SLAB_ALIGNMENT - 1);
+}
+
+int initNameIndex(tNameIndex *index, size_t maxNames, tSlab *parent) {
+
+  if (initSlab(&(index->slab), nameIndexMemory(maxNames), parent) != 0)
+    return -1;
+
+  for (int i = 0; i < NAME_STRIPES; i++) {
+    tNameStripe *stripe = &(index->stripes[i]);
+
+    stripe->slots = (tNameSlot *)slabAlloc(
+        &(index->slab), NAME_STRIPE_SLOTS * sizeof(tNameSlot));
+    if (stripe->slots == NULL)
+      return -1;
+
+    stripe->capacity = NAME_STRIPE_SLOTS;
+    stripe->count = 0;
+    stripe->freeNames = NULL;
+    initSharedMutex(&(stripe->mutex));
+  }
+
+  return 0;
+}
+
+int addName(tNameIndex *index, const char *name) {
+
+  uint64_t hash = hashName(name);
+  tNameStripe *stripe = &(index->stripes[hash % NAME_STRIPES]);
+  char *copy;
+  int slot;
+
+  metricsLock(&(stripe->mutex));
+
+  slot = findSlot(stripe, hash, name);
+  if (stripe->slots[slot].name != NULL) {
+    pthread_mutex_unlock(&(stripe->mutex));
+    return ERROR_NAME_REPEATED;
+  }
+
+  // Como mucho medio llena: las busquedas recorren pocos huecos
+  if (2 * (stripe->count + 1) > stripe->capacity) {
+    if (growStripe(index, stripe) != 0) {
+      pthread_mutex_unlock(&(stripe->mutex));
+      return ERROR_SERVER_FULL;
+    }
+    slot = findSlot(stripe, hash, name);
+  }
+
+  copy = allocName(index, stripe);
+  if (copy == NULL) {
+    pthread_mutex_unlock(&(stripe->mutex));
+    return ERROR_SERVER_FULL;
+  }
+
+  strncpy(copy, name, STRING_LENGTH - 1);
+  copy[STRING_LENGTH - 1] = 0;
+
+  stripe->slots[slot].hash = hash;
+  stripe->slots[slot].name = copy;
+  stripe->count++;
+
+  pthread_mutex_unlock(&(stripe->mutex));
+  return 0;
+}
+
+void removeName(tNameIndex *index, const char *name) {
+
+  uint64_t hash = hashName(name);
+  tNameStripe *stripe = &(index->stripes[hash % NAME_STRIPES]);
+  int mask, slot, next, home;
+
+  metricsLock(&(stripe->mutex));
+
+  slot = findSlot(stripe, hash, name);
+  if (stripe->slots[slot].name == NULL) {
+    pthread_mutex_unlock(&(stripe->mutex));
+    return;
+  }
+
+  *(char **)stripe->slots[slot].name = stripe->freeNames;
+  stripe->freeNames = stripe->slots[slot].name;
+  stripe->count--;
+
+  // Sin lapidas: se adelantan los nombres que quedarian inalcanzables
+  mask = stripe->capacity - 1;
+  next = slot;
+  while (TRUE) {
+    next = (next + 1) & mask;
+    if (stripe->slots[next].name == NULL)
+      break;
+
+    // Se puede mover si su hueco inicial no esta entre slot y next
+    home = homeSlot(stripe, stripe->slots[next].hash);
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      stripe->slots[slot] = stripe->slots[next];
+      slot = next;
+    }
+  }
+
+  stripe->slots[slot].name = NULL;
+  pthread_mutex_unlock(&(stripe->mutex));
+}
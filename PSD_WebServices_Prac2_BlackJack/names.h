@@ -0,0 +1,84 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+#include "server.h"
+#include "slab.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/** Number of stripes of the name index (a power of 2) */
+#define NAME_STRIPES 64
+
+/** Initial number of slots of each stripe (a power of 2) */
+#define NAME_STRIPE_SLOTS 64
+
+/**
+ * Slot of a stripe: a name and its hash (name NULL if the slot is empty)
+ */
+typedef struct nameSlot {
+
+  uint64_t hash; /** Hash of the name */
+  char *name;    /** Copy of the name (a block of STRING_LENGTH bytes) */
+} tNameSlot;
+
+/**
+ * Stripe of the name index: an open addressing table (linear probing) with its
+ * own lock. It doubles its slots when it gets half full.
+ */
+typedef struct nameStripe {
+
+  pthread_mutex_t mutex;
+  tNameSlot *slots; /** Slots (capacity is a power of 2) */
+  int capacity;     /** Number of slots */
+  int count;        /** Names in this stripe */
+  char *freeNames;  /** Name blocks released, linked through their start */
+} __attribute__((aligned(CACHE_LINE_SIZE))) tNameStripe;
+
+/**
+ * Index of the names of all the players seated in a game. The hash of a name
+ * selects its stripe (low bits) and its first slot (high bits), so checking
+ * for a repeated name costs O(1) and only locks one stripe.
+ */
+typedef struct nameIndex {
+
+  tSlab slab; /** Memory of the names and the slots (up to the limit) */
+  tNameStripe stripes[NAME_STRIPES];
+} tNameIndex;
+
+/**
+ * Memory reserved by initNameIndex for a number of names.
+ *
+ * @param maxNames Maximum number of names.
+ * @return Size of the slab of the index.
+ */
+size_t nameIndexMemory(size_t maxNames);
+
+/**
+ * Initializes an empty index.
+ *
+ * @param index Index to be initialized.
+ * @param maxNames Maximum number of names (two per game of the table).
+ * @param parent Slab the memory is taken from (memory budget), or NULL.
+ * @return 0 on success, -1 on error.
+ */
+int initNameIndex(tNameIndex *index, size_t maxNames, tSlab *parent);
+
+/**
+ * Adds a name, unless it is already in the index.
+ *
+ * @param index Name index.
+ * @param name Name (shorter than STRING_LENGTH).
+ * @return 0 if the name has been added, ERROR_NAME_REPEATED if it was already
+ * there, or ERROR_SERVER_FULL if there is no memory for it.
+ */
+int addName(tNameIndex *index, const char *name);
+
+/**
+ * Removes a name (nothing is done if it is not in the index).
+ *
+ * @param index Name index.
+ * @param name Name.
+ */
+void removeName(tNameIndex *index, const char *name);
+
+#endif
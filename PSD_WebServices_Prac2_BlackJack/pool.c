@@ -0,0 +1,192 @@
+#include "pool.h"
+
+static tJob dequeueJob(tJobQueue *queue) {
+
+  tJob job;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  while (queue->count == 0)
+    pthread_cond_wait(&queue->notEmpty, &queue->mutex);
+
+  job = queue->jobs[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+
+  pthread_cond_signal(&queue->notFull);
+  pthread_mutex_unlock(&queue->mutex);
+
+  return job;
+}
+
+/**
+ * Default handler: serves all the requests of an accepted socket.
+ */
+static void serveSocket(tWorker *worker, tJob *job) {
+
+  struct soap *soap = worker->soap;
+
+  soap->socket = job->socket;
+  soap_serve(soap);
+
+  // Liberar lo reservado en la peticion, el contexto se reutiliza
+  soap_destroy(soap);
+  soap_end(soap);
+  soap_force_closesock(soap);
+}
+
+static void *workerThread(void *arg) {
+
+  tWorker *worker = (tWorker *)arg;
+  tJob job;
+
+  setThreadArena(&(worker->arena));
+
+  // Un trabajo sin socket ni datos indica que hay que terminar
+  while (TRUE) {
+
+    job = dequeueJob(&(worker->pool->queue));
+
+    if (!soap_valid_socket(job.socket) && job.data == NULL)
+      break;
+
+    if (job.handler != NULL)
+      job.handler(worker, &job);
+    else
+      worker->pool->handler(worker, &job);
+  }
+
+  return NULL;
+}
+
+int initWorkerPool(tWorkerPool *pool, struct soap *master, int numWorkers,
+                   int queueSize, tJobHandler handler) {
+
+  tJobQueue *queue = &(pool->queue);
+
+  // Init queue
+  queue->jobs = (tJob *)malloc(queueSize * sizeof(tJob));
+  if (queue->jobs == NULL)
+    return -1;
+
+  queue->capacity = queueSize;
+  queue->head = 0;
+  queue->count = 0;
+  pthread_mutex_init(&(queue->mutex), NULL);
+  pthread_cond_init(&(queue->notEmpty), NULL);
+  pthread_cond_init(&(queue->notFull), NULL);
+
+  pool->handler = (handler != NULL) ? handler : serveSocket;
+
+  // Init workers
+  pool->numWorkers = 0;
+  pool->workers = (tWorker *)calloc(numWorkers, sizeof(tWorker));
+  if (pool->workers == NULL) {
+    stopWorkerPool(pool);
+    return -1;
+  }
+
+  for (int i = 0; i < numWorkers; i++) {
+
+    tWorker *worker = &(pool->workers[i]);
+
+    worker->index = i;
+    worker->pool = pool;
+    worker->soap = soap_copy(master);
+
+    if (worker->soap == NULL)
+      break;
+
+    if (initArena(&(worker->arena), WORKER_ARENA_SIZE) != 0) {
+      soap_free(worker->soap);
+      break;
+    }
+
+    if (pthread_create(&(worker->thread), NULL, workerThread, worker) != 0) {
+      soap_free(worker->soap);
+      freeArena(&(worker->arena));
+      break;
+    }
+
+    pool->numWorkers++;
+  }
+
+  // Fallo a medias: se paran los que ya estan en marcha y se libera todo
+  if (pool->numWorkers < numWorkers) {
+    stopWorkerPool(pool);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Adds a job to a queue with room for it. The queue mutex must be held.
+ */
+static void pushJob(tJobQueue *queue, tJob job) {
+
+  queue->jobs[(queue->head + queue->count) % queue->capacity] = job;
+  queue->count++;
+
+  pthread_cond_signal(&queue->notEmpty);
+}
+
+void enqueueJob(tWorkerPool *pool, tJob job) {
+
+  tJobQueue *queue = &(pool->queue);
+
+  pthread_mutex_lock(&queue->mutex);
+
+  // Cola llena: el productor espera (backpressure)
+  while (queue->count == queue->capacity)
+    pthread_cond_wait(&queue->notFull, &queue->mutex);
+
+  pushJob(queue, job);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+int tryEnqueueJob(tWorkerPool *pool, tJob job) {
+
+  tJobQueue *queue = &(pool->queue);
+  int full;
+
+  pthread_mutex_lock(&queue->mutex);
+
+  full = (queue->count == queue->capacity);
+  if (!full)
+    pushJob(queue, job);
+
+  pthread_mutex_unlock(&queue->mutex);
+
+  return full ? -1 : 0;
+}
+
+void enqueueSocket(tWorkerPool *pool, SOAP_SOCKET socket) {
+
+  tJob job = {socket, NULL, NULL};
+
+  enqueueJob(pool, job);
+}
+
+void stopWorkerPool(tWorkerPool *pool) {
+
+  tJob stop = {SOAP_INVALID_SOCKET, NULL, NULL};
+
+  // One stop job for each worker
+  for (int i = 0; i < pool->numWorkers; i++)
+    enqueueJob(pool, stop);
+
+  for (int i = 0; i < pool->numWorkers; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+    soap_destroy(pool->workers[i].soap);
+    soap_end(pool->workers[i].soap);
+    soap_free(pool->workers[i].soap);
+    freeArena(&(pool->workers[i].arena));
+  }
+
+  free(pool->workers);
+  free(pool->queue.jobs);
+  pthread_mutex_destroy(&(pool->queue.mutex));
+  pthread_cond_destroy(&(pool->queue.notEmpty));
+  pthread_cond_destroy(&(pool->queue.notFull));
+}
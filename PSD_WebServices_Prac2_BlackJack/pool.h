@@ -0,0 +1,120 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "slab.h"
+#include "soapH.h"
+#include <pthread.h>
+
+/** Default number of worker threads */
+#define DEFAULT_WORKERS 16
+
+/** Default capacity of the queue of pending jobs */
+#define DEFAULT_QUEUE_SIZE 256
+
+struct job;
+struct worker;
+struct workerPool;
+
+/** Function that serves one job */
+typedef void (*tJobHandler)(struct worker *worker, struct job *job);
+
+/**
+ * Job for a worker: an accepted socket, or a connection of the reactor.
+ * A job with an invalid socket and no data stops the worker.
+ */
+typedef struct job {
+
+  SOAP_SOCKET socket;  /** Accepted socket to be served */
+  void *data;          /** Connection to be served (reactor mode) */
+  tJobHandler handler; /** Handler of this job, NULL for the pool's one */
+} tJob;
+
+/**
+ * Bounded queue of jobs waiting to be served
+ */
+typedef struct jobQueue {
+
+  tJob *jobs;   /** Circular buffer of jobs */
+  int capacity; /** Maximum number of queued jobs */
+  int head;     /** Position of the oldest job */
+  int count;    /** Number of queued jobs */
+
+  pthread_mutex_t mutex;
+  pthread_cond_t notEmpty; /** Signaled when a job is queued */
+  pthread_cond_t notFull;  /** Signaled when a job is dequeued */
+} tJobQueue;
+
+/**
+ * Worker thread with its own (reused) soap context
+ */
+typedef struct worker {
+
+  int index;               /** Position of this worker in the pool */
+  struct soap *soap;       /** Soap context reused across connections */
+  struct workerPool *pool; /** Pool this worker belongs to */
+  pthread_t thread;        /** Thread running this worker */
+  tArena arena;            /** Scratch memory of the requests it serves */
+} tWorker;
+
+/**
+ * Fixed set of pre-spawned workers fed by a bounded job queue
+ */
+typedef struct workerPool {
+
+  int numWorkers;      /** Number of workers */
+  tWorker *workers;    /** Workers */
+  tJobQueue queue;     /** Jobs pending to be served */
+  tJobHandler handler; /** Function that serves each job */
+} tWorkerPool;
+
+/**
+ * Creates the queue and spawns the workers. Each worker gets a copy of the
+ * master soap context and a scratch arena, reused for every job it serves.
+ *
+ * @param pool Pool to be initialized.
+ * @param master Master soap context (already bound).
+ * @param numWorkers Number of worker threads.
+ * @param queueSize Capacity of the job queue.
+ * @param handler Function that serves each job, or NULL to serve each
+ * accepted socket with soap_serve.
+ * @return 0 on success, -1 on error (the workers already started are stopped
+ * and everything is released).
+ */
+int initWorkerPool(tWorkerPool *pool, struct soap *master, int numWorkers,
+                   int queueSize, tJobHandler handler);
+
+/**
+ * Queues a job. If the queue is full, the caller is blocked until a worker
+ * takes a job (backpressure on the producer).
+ *
+ * @param pool Worker pool.
+ * @param job Job to be served.
+ */
+void enqueueJob(tWorkerPool *pool, tJob job);
+
+/**
+ * Queues a job only if there is room for it, without blocking.
+ *
+ * @param pool Worker pool.
+ * @param job Job to be served.
+ * @return 0 if the job was queued, -1 if the queue is full.
+ */
+int tryEnqueueJob(tWorkerPool *pool, tJob job);
+
+/**
+ * Queues an accepted socket to be served with soap_serve.
+ *
+ * @param pool Worker pool.
+ * @param socket Accepted socket.
+ */
+void enqueueSocket(tWorkerPool *pool, SOAP_SOCKET socket);
+
+/**
+ * Stops the workers once the queued jobs are served, and releases the
+ * resources of the pool.
+ *
+ * @param pool Worker pool.
+ */
+void stopWorkerPool(tWorkerPool *pool);
+
+#endif
@@ -0,0 +1,382 @@
+#include "reactor.h"
+#include "metrics.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * Watches a connection until its next request arrives (only once).
+ */
+static void watchConnection(tReactor *reactor, tConnection *connection,
+                            int operation) {
+
+  struct epoll_event event;
+
+  __atomic_store_n(&(connection->state), connectionIdle, __ATOMIC_RELEASE);
+
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = connection;
+  epoll_ctl(reactor->epollFd, operation, connection->soap->socket, &event);
+}
+
+/**
+ * Watches a parked connection until the client closes it (only once).
+ */
+static void watchHangUp(tReactor *reactor, tConnection *connection) {
+
+  struct epoll_event event;
+
+  event.events = EPOLLRDHUP | EPOLLONESHOT;
+  event.data.ptr = connection;
+  epoll_ctl(reactor->epollFd, EPOLL_CTL_MOD, connection->soap->socket, &event);
+}
+
+/**
+ * Closes a connection and keeps it to be reused with another socket.
+ */
+static void closeConnection(tConnection *connection) {
+
+  tReactor *reactor = connection->reactor;
+
+  // Al cerrar el socket tambien sale del epoll
+  soap_force_closesock(connection->soap);
+
+  pthread_mutex_lock(&(reactor->mutex));
+  connection->next = reactor->freeList;
+  reactor->freeList = connection;
+  pthread_mutex_unlock(&(reactor->mutex));
+}
+
+/**
+ * Hands a connection to the event loop, so it is queued in the pool.
+ */
+static void readyConnection(tConnection *connection) {
+
+  tReactor *reactor = connection->reactor;
+  uint64_t one = 1;
+
+  pthread_mutex_lock(&(reactor->mutex));
+  connection->next = reactor->ready;
+  reactor->ready = connection;
+  pthread_mutex_unlock(&(reactor->mutex));
+
+  write(reactor->wakeFd, &one, sizeof(one));
+}
+
+/**
+ * Job handler of a parked connection closed by the client: takes it out of
+ * its game and closes it.
+ */
+static void hangUpConnection(tWorker *worker, tJob *job) {
+
+  tConnection *connection = (tConnection *)job->data;
+
+  // Espera a que el worker que la aparco la suelte
+  pthread_mutex_lock(&(connection->mutex));
+  cancelGetStatus(connection->soap, connection->gameId, connection->player);
+  connection->parked = FALSE;
+  soap_destroy(connection->soap);
+  soap_end(connection->soap);
+  pthread_mutex_unlock(&(connection->mutex));
+
+  closeConnection(connection);
+}
+
+/**
+ * Job of a connection: a request or a resumed getStatus (the pool's handler),
+ * or a parked getStatus whose client has gone.
+ */
+static tJob connectionJob(tConnection *connection) {
+
+  tJob job = {SOAP_INVALID_SOCKET, connection, NULL};
+
+  if (__atomic_load_n(&(connection->state), __ATOMIC_ACQUIRE) ==
+      connectionHungUp)
+    job.handler = hangUpConnection;
+
+  return job;
+}
+
+/**
+ * Queues a connection in the pool without blocking the event loop. If the
+ * queue is full it is kept in the backlog (in order), and queued later.
+ */
+static void handOver(tReactor *reactor, tConnection *connection) {
+
+  if (reactor->backlog == NULL &&
+      tryEnqueueJob(reactor->pool, connectionJob(connection)) == 0)
+    return;
+
+  connection->later = NULL;
+  if (reactor->backlog == NULL)
+    reactor->backlog = connection;
+  else
+    reactor->backlogTail->later = connection;
+  reactor->backlogTail = connection;
+}
+
+/**
+ * Queues the backlog, until the queue is full again.
+ */
+static void flushBacklog(tReactor *reactor) {
+
+  tConnection *connection;
+
+  while (reactor->backlog != NULL) {
+    connection = reactor->backlog;
+
+    if (tryEnqueueJob(reactor->pool, connectionJob(connection)) != 0)
+      return;
+
+    reactor->backlog = connection->later;
+  }
+}
+
+/**
+ * Handles an epoll event of a connection. Only an idle connection (a new
+ * request) or a parked one (closed by the client) is handed to the pool; an
+ * event that arrives once the connection has moved on is stale.
+ */
+static void connectionEvent(tReactor *reactor, tConnection *connection) {
+
+  int expected = connectionIdle;
+
+  if (__atomic_compare_exchange_n(&(connection->state), &expected,
+                                  connectionBusy, FALSE, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_ACQUIRE)) {
+    handOver(reactor, connection);
+    return;
+  }
+
+  // Si se ha despertado a la vez, wakeParked ya la ha dado por suya
+  expected = connectionParked;
+  if (__atomic_compare_exchange_n(&(connection->state), &expected,
+                                  connectionHungUp, FALSE, __ATOMIC_ACQ_REL,
+                                  __ATOMIC_ACQUIRE))
+    handOver(reactor, connection);
+}
+
+static void *eventLoop(void *arg) {
+
+  tReactor *reactor = (tReactor *)arg;
+  struct epoll_event events[REACTOR_EVENTS];
+  tConnection *connection, *next;
+  uint64_t count;
+  int numEvents;
+
+  while (TRUE) {
+
+    // Con trabajo pendiente no se bloquea: se reintenta en cuanto haya hueco
+    numEvents = epoll_wait(reactor->epollFd, events, REACTOR_EVENTS,
+                           (reactor->backlog != NULL) ? REACTOR_RETRY_INTERVAL
+                                                      : -1);
+    flushBacklog(reactor);
+
+    for (int i = 0; i < numEvents; i++) {
+
+      // Conexion con una peticion nueva, o aparcada y cerrada por el cliente
+      if (events[i].data.ptr != NULL) {
+        connectionEvent(reactor, (tConnection *)events[i].data.ptr);
+        continue;
+      }
+
+      // Conexiones reanudadas (getStatus aparcados o peticiones en el buffer)
+      read(reactor->wakeFd, &count, sizeof(count));
+
+      pthread_mutex_lock(&(reactor->mutex));
+      connection = reactor->ready;
+      reactor->ready = NULL;
+      pthread_mutex_unlock(&(reactor->mutex));
+
+      while (connection != NULL) {
+        next = connection->next;
+        handOver(reactor, connection);
+        connection = next;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int initReactor(tReactor *reactor, struct soap *master, tWorkerPool *pool) {
+
+  struct epoll_event event;
+
+  reactor->master = master;
+  reactor->pool = pool;
+  reactor->ready = NULL;
+  reactor->freeList = NULL;
+  reactor->backlog = NULL;
+  reactor->backlogTail = NULL;
+  pthread_mutex_init(&(reactor->mutex), NULL);
+
+  reactor->epollFd = epoll_create1(0);
+  reactor->wakeFd = eventfd(0, EFD_NONBLOCK);
+
+  if (reactor->epollFd < 0 || reactor->wakeFd < 0)
+    return -1;
+
+  // El eventfd se distingue por no tener conexion asociada
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, reactor->wakeFd, &event) < 0)
+    return -1;
+
+  if (pthread_create(&(reactor->thread), NULL, eventLoop, reactor) != 0)
+    return -1;
+
+  return 0;
+}
+
+void addConnection(tReactor *reactor, SOAP_SOCKET socket) {
+
+  tConnection *connection;
+
+  pthread_mutex_lock(&(reactor->mutex));
+  connection = reactor->freeList;
+  if (connection != NULL)
+    reactor->freeList = connection->next;
+  pthread_mutex_unlock(&(reactor->mutex));
+
+  // Reutilizar el contexto de una conexion cerrada, o copiar uno nuevo
+  if (connection == NULL) {
+    connection = (tConnection *)calloc(1, sizeof(tConnection));
+
+    if (connection != NULL)
+      connection->soap = soap_copy(reactor->master);
+
+    if (connection == NULL || connection->soap == NULL) {
+      free(connection);
+      close(socket);
+      return;
+    }
+
+    connection->reactor = reactor;
+    connection->soap->user = connection;
+    pthread_mutex_init(&(connection->mutex), NULL);
+  }
+
+  connection->soap->socket = socket;
+  connection->soap->keep_alive = connection->soap->max_keep_alive + 1;
+  connection->parked = FALSE;
+
+  watchConnection(reactor, connection, EPOLL_CTL_ADD);
+}
+
+void serveConnection(tWorker *worker, tJob *job) {
+
+  tConnection *connection = (tConnection *)job->data;
+  struct soap *soap = connection->soap;
+  int error = SOAP_OK;
+
+  // Si el getStatus se acaba de aparcar, se espera a que el otro worker suelte
+  // la conexion
+  pthread_mutex_lock(&(connection->mutex));
+
+  if (connection->parked) {
+    connection->parked = FALSE;
+    error = resumeGetStatus(soap, connection->gameId, connection->player,
+                            connection->nonce);
+
+    // Latencia desde que llego la peticion, espera incluida
+    if (error != SOAP_PARKED)
+      metricsRecordRpc(metricsGetStatus, connection->start);
+  } else {
+
+    // Una iteracion del bucle de soap_serve
+    connection->start = metricsNow();
+    if (soap->keep_alive > 0 && soap->max_keep_alive > 0)
+      soap->keep_alive--;
+
+    if (soap_begin_serve(soap)) {
+      error = soap->error;
+    } else if (soap_serve_request(soap) && soap->error &&
+               soap->error < SOAP_STOP) {
+      error = soap->error;
+      soap_send_fault(soap);
+    } else {
+      error = soap->error;
+    }
+  }
+
+  // La conexion queda en la lista del juego hasta que cambie; mientras, solo
+  // se vigila si el cliente la cierra
+  if (error == SOAP_PARKED) {
+    watchHangUp(connection->reactor, connection);
+    pthread_mutex_unlock(&(connection->mutex));
+    return;
+  }
+
+  soap_destroy(soap);
+  soap_end(soap);
+  pthread_mutex_unlock(&(connection->mutex));
+
+  if ((error != SOAP_OK && error < SOAP_STOP) ||
+      !soap_valid_socket(soap->socket) || !soap->keep_alive)
+    closeConnection(connection);
+  else if (soap->bufidx < soap->buflen)
+    readyConnection(connection);
+  else
+    watchConnection(connection->reactor, connection, EPOLL_CTL_MOD);
+}
+
+void parkConnection(tGame *game, struct soap *soap, tPlayer player) {
+
+  tConnection *connection = (tConnection *)soap->user;
+
+  connection->parked = TRUE;
+  connection->gameId = game->id;
+  connection->player = player;
+  connection->nonce =
+      (player == player1) ? game->player1Nonce : game->player2Nonce;
+  __atomic_store_n(&(connection->state), connectionParked, __ATOMIC_RELEASE);
+  if (player == player1) {
+    connection->next = game->player1Parked;
+    game->player1Parked = connection;
+  } else {
+    connection->next = game->player2Parked;
+    game->player2Parked = connection;
+  }
+}
+
+void wakeParked(tGame *game, tPlayer player) {
+
+  tConnection *connection, *next;
+  int expected;
+
+  if (player == player1) {
+    connection = game->player1Parked;
+    game->player1Parked = NULL;
+  } else {
+    connection = game->player2Parked;
+    game->player2Parked = NULL;
+  }
+
+  while (connection != NULL) {
+    next = connection->next;
+
+    // Las cerradas por el cliente ya tienen su trabajo (hangUpConnection)
+    expected = connectionParked;
+    if (__atomic_compare_exchange_n(&(connection->state), &expected,
+                                    connectionBusy, FALSE, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE))
+      readyConnection(connection);
+
+    connection = next;
+  }
+}
+
+void unparkConnection(tGame *game, struct soap *soap, tPlayer player) {
+
+  tConnection *connection = (tConnection *)soap->user;
+  tConnection **link = (player == player1) ? &(game->player1Parked)
+                                           : &(game->player2Parked);
+
+  // Si ya no esta, wakeParked la ha sacado de la lista al despertar al jugador
+  while (*link != NULL && *link != connection)
+    link = &((*link)->next);
+
+  if (*link != NULL)
+    *link = connection->next;
+}
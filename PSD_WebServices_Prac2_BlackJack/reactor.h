@@ -0,0 +1,125 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "pool.h"
+#include "server.h"
+#include <pthread.h>
+
+/** Maximum number of events read in each call to epoll_wait */
+#define REACTOR_EVENTS 64
+
+/** Interval between two attempts to queue the backlog (in milliseconds) */
+#define REACTOR_RETRY_INTERVAL 1
+
+struct reactor;
+
+/**
+ * Who owns a connection. Only the event loop takes a connection out of
+ * connectionIdle or connectionParked (with an atomic exchange), so an event
+ * and a wake up never hand the same connection to two workers.
+ */
+typedef enum {
+  connectionIdle,   /** Watched until its next request arrives */
+  connectionBusy,   /** Queued or being served by a worker */
+  connectionParked, /** Its getStatus is parked in a game */
+  connectionHungUp  /** Parked, and the client has closed it */
+} tConnectionState;
+
+/**
+ * Client connection in reactor mode. Each connection owns a soap context, so
+ * a request can be parked without keeping a thread.
+ */
+typedef struct connection {
+
+  struct soap *soap;        /** Soap context of this connection */
+  struct reactor *reactor;  /** Reactor this connection belongs to */
+  struct connection *next;  /** Next connection in its list */
+  struct connection *later; /** Next connection in the backlog */
+  pthread_mutex_t mutex;    /** Held by the worker serving the connection */
+  int state;                /** tConnectionState (atomic) */
+  int parked;               /** TRUE if a getStatus is parked in a game */
+  int gameId;               /** Game of the parked getStatus */
+  tPlayer player;           /** Player of the parked getStatus */
+  uint32_t nonce;           /** Nonce of the seat when it was parked */
+  unsigned long long start; /** Time when the current request arrived */
+} tConnection;
+
+/**
+ * Event loop that watches idle connections with epoll. Readable connections
+ * and resumed getStatus calls are handed to the worker pool.
+ */
+typedef struct reactor {
+
+  int epollFd;          /** Idle connections (EPOLLONESHOT) */
+  int wakeFd;           /** Eventfd to notify resumed connections */
+  pthread_t thread;     /** Thread running the event loop */
+  struct soap *master;  /** Master soap context (to copy new contexts) */
+  tWorkerPool *pool;    /** Workers that serve the requests */
+
+  pthread_mutex_t mutex;
+  tConnection *ready;    /** Connections to be handed to the pool */
+  tConnection *freeList; /** Closed connections, ready to be reused */
+
+  // Solo los usa el bucle de eventos
+  tConnection *backlog;     /** Connections that did not fit in the queue */
+  tConnection *backlogTail; /** Last connection of the backlog */
+} tReactor;
+
+/**
+ * Creates the epoll instance and starts the event loop.
+ *
+ * @param reactor Reactor to be initialized.
+ * @param master Master soap context (already bound).
+ * @param pool Workers that serve the requests (with serveConnection).
+ * @return 0 on success, -1 on error.
+ */
+int initReactor(tReactor *reactor, struct soap *master, tWorkerPool *pool);
+
+/**
+ * Adds an accepted socket to the reactor.
+ *
+ * @param reactor Reactor.
+ * @param socket Accepted socket.
+ */
+void addConnection(tReactor *reactor, SOAP_SOCKET socket);
+
+/**
+ * Job handler for the worker pool: serves one request of a connection, or
+ * finishes its parked getStatus.
+ *
+ * @param worker Worker serving the job.
+ * @param job Job with the connection.
+ */
+void serveConnection(tWorker *worker, tJob *job);
+
+/**
+ * Parks the getStatus of a connection in a game, until the player is woken up.
+ * The game mutex must be held. While it is parked, the event loop only
+ * watches whether the client closes the connection.
+ *
+ * @param game Game.
+ * @param soap Soap context of the connection.
+ * @param player Player of the getStatus.
+ */
+void parkConnection(tGame *game, struct soap *soap, tPlayer player);
+
+/**
+ * Resumes the getStatus calls of a player parked in a game. The game mutex
+ * must be held.
+ *
+ * @param game Game that has changed.
+ * @param player Player to be resumed.
+ */
+void wakeParked(tGame *game, tPlayer player);
+
+/**
+ * Removes a parked getStatus from the list of its game (the client closed the
+ * connection). The game mutex must be held.
+ *
+ * @param game Game.
+ * @param soap Soap context of the connection.
+ * @param player Player of the getStatus.
+ */
+void unparkConnection(tGame *game, struct soap *soap, tPlayer player);
+
+#endif
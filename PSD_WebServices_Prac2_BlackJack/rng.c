@@ -0,0 +1,39 @@
+#include "rng.h"
+
+/** Multiplier of the PCG32 LCG */
+#define PCG_MULTIPLIER 6364136223846793005ULL
+
+void seedRng(tRng *rng, uint64_t seed, uint64_t sequence) {
+
+  rng->state = 0;
+  rng->inc = (sequence << 1) | 1;
+  nextRandom(rng);
+  rng->state += seed;
+  nextRandom(rng);
+}
+
+uint32_t nextRandom(tRng *rng) {
+
+  uint64_t old = rng->state;
+  uint32_t xorshifted, rotation;
+
+  // LCG de 64 bits, salida permutada (xorshift + rotacion)
+  rng->state = old * PCG_MULTIPLIER + rng->inc;
+  xorshifted = ((old >> 18) ^ old) >> 27;
+  rotation = old >> 59;
+
+  return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31));
+}
+
+uint32_t randomBelow(tRng *rng, uint32_t bound) {
+
+  // Descartar los valores que sesgarian el modulo
+  uint32_t threshold = -bound % bound;
+  uint32_t value;
+
+  do {
+    value = nextRandom(rng);
+  } while (value < threshold);
+
+  return value % bound;
+}
@@ -0,0 +1,43 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/**
+ * State of a PCG32 generator. Each game has its own one, so threads never
+ * share a generator (unlike rand).
+ */
+typedef struct rng {
+
+  uint64_t state; /** Current state */
+  uint64_t inc;   /** Stream (must be odd) */
+} tRng;
+
+/**
+ * Seeds a generator.
+ *
+ * @param rng Generator.
+ * @param seed Initial state.
+ * @param sequence Stream: generators with the same seed and different
+ * streams produce different sequences.
+ */
+void seedRng(tRng *rng, uint64_t seed, uint64_t sequence);
+
+/**
+ * Gets the next random number.
+ *
+ * @param rng Generator.
+ * @return Random number (32 bits).
+ */
+uint32_t nextRandom(tRng *rng);
+
+/**
+ * Gets a random number in [0, bound), without modulo bias.
+ *
+ * @param rng Generator.
+ * @param bound Upper bound (not included), greater than 0.
+ * @return Random number below bound.
+ */
+uint32_t randomBelow(tRng *rng, uint32_t bound);
+
+#endif
@@ -1,13 +1,77 @@
+#include "blackJackns.nsmap"
 #include "server.h"
+#include "acceptor.h"
+#include "binary.h"
+#include "pool.h"
+#include "matchmaking.h"
+#include "names.h"
+#include "journal.h"
+#include "shared.h"
+#include "messages.h"
+#include "logger.h"
+#include "metrics.h"
+#include "reactor.h"
+#include "table.h"
 #include "soapH.h"
+#include <getopt.h>
+#include <limits.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
-/** Shared array that contains all the games. */
-tGame games[MAX_GAMES];
+/** Games, matchmaking and names, when they are not in a shared segment */
+static tSharedState localState;
+
+/** Shared table that contains all the games. */
+tGameTable *gameTable;
+
+/** Queue of games waiting for a second player and free list of games */
+tMatchmaker *matchmaker;
+
+/** Names of the players seated in any game */
+tNameIndex *nameIndex;
+
+/** Journal of game events (disabled unless --journal is given) */
+tJournal journal;
+
+/** Workers that serve the requests */
+tWorkerPool workerPool;
+
+/** Thread that resets the abandoned games */
+static pthread_t reaper;
+
+/** Acceptors, each one with its own workers (with more than one) */
+tAcceptor *acceptors;
+int numAcceptors = DEFAULT_ACCEPTORS;
+
+/** Points of each card (no need to compute card % SUIT_SIZE) */
+#define SUIT_POINTS                                                            \
+  1, 2, 3, 4, 5, 6, 7, 8, 9, FIGURE_VALUE, FIGURE_VALUE, FIGURE_VALUE,         \
+      FIGURE_VALUE
+static const unsigned char cardPoints[DECK_SIZE] = {SUIT_POINTS, SUIT_POINTS,
+                                                    SUIT_POINTS, SUIT_POINTS};
+
+/** Message and cards of the response of each thread (copyGameStatusCode) */
+static __thread tResponseBlock responseBlock;
+
+/** Last journal record of the moves served by this thread (see syncMoves) */
+static __thread uint64_t moveLsn;
+
+/** Seed of the random number generators of the games */
+uint64_t rngSeed;
 
 void initGameSyncPrimitives(tGame *game) {
-  pthread_mutex_init(&(game->mutex), NULL);
-  pthread_cond_init(&(game->cond), NULL);
+
+  // Compartidos entre procesos con --shared
+  initSharedMutex(&(game->mutex));
+  initSharedCond(&(game->player1Cond));
+  initSharedCond(&(game->player2Cond));
+}
+
+void initGameRng(tGame *game) {
+
+  // Misma semilla, pero una secuencia distinta por juego
+  seedRng(&(game->rng), rngSeed, game->id);
 }
 
 void initGame(tGame *game) {
@@ -16,10 +80,16 @@ void initGame(tGame *game) {
   memset(game->player1Name, 0, STRING_LENGTH);
   memset(game->player2Name, 0, STRING_LENGTH);
 
-  // Alloc memory for the decks
+  // Los asientos de la partida anterior dejan de valer
+  game->player1Nonce = 0;
+  game->player2Nonce = 0;
+
+  // Clear the decks (the game deck is filled when the game starts)
   clearDeck(&(game->player1Deck));
   clearDeck(&(game->player2Deck));
-  initDeck(&(game->gameDeck));
+  clearScore(&(game->player1Score));
+  clearScore(&(game->player2Score));
+  clearDeck(&(game->gameDeck));
 
   // Bet and stack
   game->player1Bet = 0;
@@ -35,66 +105,310 @@ void initGame(tGame *game) {
   game->player2Stood = FALSE;
 }
 
-void initServerStructures(struct soap *soap) {
+/**
+ * Wakes up only the given player, whether he is blocked in getStatus or his
+ * getStatus is parked. The game mutex must be held.
+ */
+static void wakePlayer(tGame *game, tPlayer player) {
+
+  if (player == player1)
+    pthread_cond_broadcast(&game->player1Cond);
+  else
+    pthread_cond_broadcast(&game->player2Cond);
+
+  wakeParked(game, player);
+}
+
+/**
+ * Wakes up both players (end of the game). The game mutex must be held.
+ */
+static void wakeBothPlayers(tGame *game) {
+  wakePlayer(game, player1);
+  wakePlayer(game, player2);
+}
+
+/**
+ * Nonce of a seat (0 if it is empty). It changes each time the game is reset,
+ * so a call that waited in a seat can tell whether it is still its own.
+ */
+static uint32_t seatNonce(tGame *game, tPlayer player) {
+  return (player == player1) ? game->player1Nonce : game->player2Nonce;
+}
+
+/**
+ * Current time in seconds (CLOCK_MONOTONIC, the same in every process).
+ */
+static uint32_t nowSeconds() {
+  return (uint32_t)(metricsNow() / 1000000000ULL);
+}
+
+/**
+ * Resets a game that has ended or has been abandoned, and releases the names
+ * of its players. The players still waiting are woken up. The game mutex must
+ * be held; the caller gives the game back to the free list (releaseGame) once
+ * it is unlocked.
+ */
+static void endGame(tGame *game) {
+
+  wakeBothPlayers(game);
+  removeName(nameIndex, game->player1Name);
+  removeName(nameIndex, game->player2Name);
+  initGame(game);
+  appendJournal(&journal, game, journalEnd);
+}
+
+/**
+ * Rebuilds the names and the matchmaking lists from the games restored by the
+ * journal.
+ */
+static void restoreGames() {
+
+  tGame *game;
+  uint32_t now = nowSeconds();
+
+  for (int id = 0; id < gameTable->maxGames; id++) {
+    game = getGame(gameTable, id);
+    if (game == NULL)
+      continue;
+
+    // El plazo de abandono se cuenta desde el arranque
+    game->lastMove = now;
+
+    if (game->status != gameEmpty)
+      addName(nameIndex, game->player1Name);
+    if (game->status == gameReady)
+      addName(nameIndex, game->player2Name);
+
+    restoreGame(matchmaker, game);
+  }
+}
+
+/**
+ * Reaper thread: every GAME_REAP_INTERVAL, resets the games whose current
+ * player has not moved for GAME_IDLE_TIMEOUT. Their names and seats are
+ * released even if no one asks for their status again, and the rival, if it
+ * is still waiting, finds that its seat is gone.
+ */
+static void *reaperThread(void *arg) {
+
+  tGame *game;
+  uint32_t now;
+  int reaped;
+
+  while (TRUE) {
+
+    sleep(GAME_REAP_INTERVAL);
+    now = nowSeconds();
+    reaped = 0;
+
+    for (int id = 0; id < gameTable->maxGames; id++) {
+      game = getGame(gameTable, id);
+
+      // Lectura sin bloquear: solo se bloquean los candidatos
+      if (game == NULL ||
+          __atomic_load_n(&(game->status), __ATOMIC_RELAXED) != gameReady ||
+          now - __atomic_load_n(&(game->lastMove), __ATOMIC_RELAXED) <
+              GAME_IDLE_TIMEOUT)
+        continue;
+
+      metricsLock(&game->mutex);
+      if (game->status != gameReady ||
+          now - game->lastMove < GAME_IDLE_TIMEOUT) {
+        pthread_mutex_unlock(&game->mutex);
+        continue;
+      }
+
+      endGame(game);
+      pthread_mutex_unlock(&game->mutex);
+      releaseGame(matchmaker, game);
+      reaped++;
+    }
+
+    if (reaped > 0)
+      logEvent(logInfo, "[Reaper] %d abandoned games reset", NULL, reaped, 0);
+  }
+
+  return NULL;
+}
+
+/**
+ * Most games whose table and names (two per game) fit in a memory budget.
+ */
+static int gamesInBudget(size_t budget) {
+
+  size_t low = 0, high = budget / sizeof(tGame), middle;
+
+  if (high > INT_MAX)
+    high = INT_MAX;
+
+  // Las dos reservas crecen con el numero de juegos: busqueda binaria
+  while (low < high) {
+    middle = low + (high - low + 1) / 2;
+    if (gameTableMemory((int)middle) + nameIndexMemory(2 * middle) <= budget)
+      low = middle;
+    else
+      high = middle - 1;
+  }
+
+  return (int)low;
+}
+
+/**
+ * Creates the game table, the name index and the matchmaker in a state. Both
+ * the table and the index are taken from the region of the state, so together
+ * they never exceed the memory budget.
+ */
+static int initState(tSharedState *state) {
+
+  int maxGames = gamesInBudget(state->region.size);
+
+  // Games are allocated (and initialized) when the table grows
+  if (initGameTable(&(state->table), maxGames, &(state->region)) != 0)
+    return -1;
+
+  // Dos nombres por juego como mucho
+  if (initNameIndex(&(state->nameIndex), 2 * (size_t)state->table.maxGames,
+                    &(state->region)) != 0)
+    return -1;
+
+  initMatchmaker(&(state->matchmaker), &(state->table));
+  return 0;
+}
+
+int initServerStructures(int maxMemoryMB, const char *journalDir,
+                         const char *sharedName) {
+
+  tSharedState *state = &localState;
+  size_t budget = (size_t)maxMemoryMB * 1024 * 1024;
+  int created = TRUE;
+
+  logEvent(logInfo, "Initializing structures...", NULL, 0, 0);
+
+  // Init seed (each game seeds its own generator from it)
+  rngSeed = ((uint64_t)time(NULL) << 32) ^ getpid();
+
+  // Estado en memoria compartida: lo crea el primer proceso que llega
+  if (sharedName != NULL) {
+    setProcessShared(TRUE);
+    state = attachSharedState(sharedName, budget, &created);
+    if (state == NULL)
+      return -3;
+  } else if (initSlab(&(state->region), budget, NULL) != 0) {
+    return -1;
+  }
+
+  gameTable = &(state->table);
+  matchmaker = &(state->matchmaker);
+  nameIndex = &(state->nameIndex);
 
-  if (DEBUG_SERVER)
-    printf("Initializing structures...\n");
+  if (created && initState(state) != 0) {
+    if (sharedName != NULL)
+      removeSharedState(sharedName);
+    return -1;
+  }
 
-  // Init seed
-  srand(time(NULL));
+  if (sharedName != NULL && created)
+    publishSharedState(state);
 
-  // Init each game (alloc memory and init)
-  for (int i = 0; i < MAX_GAMES; i++) {
-    games[i].player1Name = (xsd__string)soap_malloc(soap, STRING_LENGTH);
-    games[i].player2Name = (xsd__string)soap_malloc(soap, STRING_LENGTH);
-    allocDeck(soap, &(games[i].player1Deck));
-    allocDeck(soap, &(games[i].player2Deck));
-    allocDeck(soap, &(games[i].gameDeck));
-    initGameSyncPrimitives(&(games[i]));
-    initGame(&(games[i]));
+  // Juegos del arranque anterior (snapshot + cola del journal)
+  if (journalDir != NULL) {
+    if (openJournal(&journal, journalDir, gameTable) != 0)
+      return -2;
+    restoreGames();
   }
+
+  // Juegos abandonados (con --shared, cada proceso revisa toda la tabla)
+  if (pthread_create(&reaper, NULL, reaperThread, NULL) != 0)
+    return -1;
+
+  return 0;
 }
 
-void initDeck(blackJackns__tDeck *deck) {
+void initDeck(tHand *deck) {
 
-  deck->__size = DECK_SIZE;
+  deck->size = DECK_SIZE;
+  deck->mask = FULL_DECK_MASK;
 
   for (int i = 0; i < DECK_SIZE; i++)
     deck->cards[i] = i;
 }
 
-void clearDeck(blackJackns__tDeck *deck) {
+void shuffleDeck(tHand *deck, tRng *rng) {
 
-  // Set number of cards
-  deck->__size = 0;
+  uint8_t card;
+  int j;
 
-  for (int i = 0; i < DECK_SIZE; i++)
-    deck->cards[i] = UNSET_CARD;
+  for (int i = deck->size - 1; i > 0; i--) {
+    j = randomBelow(rng, i + 1);
+    card = deck->cards[i];
+    deck->cards[i] = deck->cards[j];
+    deck->cards[j] = card;
+  }
+}
+
+void clearDeck(tHand *deck) {
+
+  // Las cartas de mas alla de size no se miran: no hace falta borrarlas
+  deck->size = 0;
+  deck->mask = 0;
 }
 
 tPlayer calculateNextPlayer(tPlayer currentPlayer) {
   return ((currentPlayer == player1) ? player2 : player1);
 }
 
-unsigned int getRandomCard(blackJackns__tDeck *deck) {
+unsigned int getRandomCard(tHand *deck) {
 
-  unsigned int card, cardIndex, i;
+  unsigned int card;
 
-  // Get a random card
-  cardIndex = rand() % deck->__size;
-  card = deck->cards[cardIndex];
+  // Mazo vacio: size es uint8_t y daria la vuelta
+  if (deck->size == 0)
+    return NO_CARD;
 
-  // Remove the gap
-  for (i = cardIndex; i < deck->__size - 1; i++)
-    deck->cards[i] = deck->cards[i + 1];
-
-  // Update the number of cards in the deck
-  deck->__size--;
-  deck->cards[deck->__size] = UNSET_CARD;
+  // The deck is shuffled: take the last card (no gap to remove)
+  deck->size--;
+  card = deck->cards[deck->size];
+  deck->mask &= ~(((tCardMask)1) << card);
 
   return card;
 }
 
+int dealCard(tHand *gameDeck, tHand *deck, tScore *score) {
+
+  unsigned int card = getRandomCard(gameDeck);
+
+  if (card == NO_CARD)
+    return -1;
+
+  deck->cards[deck->size++] = card;
+  deck->mask |= ((tCardMask)1) << card;
+
+  // Actualizar la puntuacion solo con la carta nueva
+  score->points += cardPoints[card];
+  if (card % SUIT_SIZE == 0)
+    score->aces++;
+
+  return 0;
+}
+
+int deckHasCard(tHand *deck, unsigned int card) {
+  return (deck->mask >> card) & 1;
+}
+
+void clearScore(tScore *score) {
+  score->points = 0;
+  score->aces = 0;
+}
+
+unsigned int softPoints(tScore *score) {
+
+  // Un as puede valer 11 (10 mas) si no se pasa
+  if (score->aces > 0 && score->points + SOFT_ACE_BONUS <= GOAL_GAME)
+    return score->points + SOFT_ACE_BONUS;
+
+  return score->points;
+}
+
 unsigned int calculatePoints(blackJackns__tDeck *deck) {
 
   unsigned int points = 0;
@@ -118,10 +432,10 @@ void copyGameStatusStructure(blackJackns__tBlock *status, char *message,
   strcpy((status->msgStruct).msg, message);
   (status->msgStruct).__size = strlen((status->msgStruct).msg);
 
-  // Copy the deck, only if it is not NULL
+  // Copy the deck (only the cards in it), only if it is not NULL
   if (newDeck->__size > 0)
     memcpy((status->deck).cards, newDeck->cards,
-           DECK_SIZE * sizeof(unsigned int));
+           newDeck->__size * sizeof(unsigned int));
   else
     (status->deck).cards = NULL;
 
@@ -131,375 +445,850 @@ void copyGameStatusStructure(blackJackns__tBlock *status, char *message,
   status->code = newCode;
 }
 
-void *processRequest(void *soap) {
+void copyGameStatusBlock(blackJackns__tBlock *status, tResponseBlock *block,
+                         int codes, int msgId, int arg0, int arg1, int arg2,
+                         tHand *newDeck, int newCode) {
 
-  pthread_detach(pthread_self());
+  blackJackns__tMessage message = {0, block->msg};
+  int deckSize = (newDeck != NULL) ? newDeck->size : 0;
 
-  printf("Processing a new request...");
+  // Solo el id y los argumentos, o el texto (directamente en el bloque)
+  if (codes)
+    packMessage(&message, msgId, arg0, arg1, arg2);
+  else
+    formatMessage(&message, msgId, arg0, arg1, arg2);
 
-  soap_serve((struct soap *)soap);
-  soap_destroy((struct soap *)soap);
-  soap_end((struct soap *)soap);
-  soap_done((struct soap *)soap);
-  free(soap);
+  block->msg[message.__size] = 0;
+  status->msgStruct = message;
 
-  return NULL;
+  // Las cartas se ensanchan a unsigned int solo aqui (formato del WSDL)
+  for (int i = 0; i < deckSize; i++)
+    block->cards[i] = newDeck->cards[i];
+
+  (status->deck).cards = (deckSize > 0) ? block->cards : NULL;
+  (status->deck).__size = deckSize;
+
+  // Set the new code
+  status->code = newCode;
 }
 
-int blackJackns__register(struct soap *soap, blackJackns__tMessage playerName,
+void copyGameStatusCode(struct soap *soap, blackJackns__tBlock *status,
+                        int msgId, int arg0, int arg1, int arg2,
+                        tHand *newDeck, int newCode) {
+
+  copyGameStatusBlock(status, &responseBlock, wantsMessageCodes(soap), msgId,
+                      arg0, arg1, arg2, newDeck, newCode);
+}
+
+int wantsMessageCodes(struct soap *soap) {
+  return strcmp(soap->path, MSG_CODES_PATH) == 0;
+}
+
+/**
+ * New nonce for a seat (never 0, which marks an empty seat).
+ */
+static uint32_t newNonce(tGame *game) {
+
+  uint32_t nonce = nextRandom(&(game->rng)) & SEAT_NONCE_MASK;
+
+  return (nonce != 0) ? nonce : 1;
+}
+
+/**
+ * Seats a player. The result is the game id or an error.
+ */
+static int registerPlayer(struct soap *soap, blackJackns__tMessage playerName,
                           int *result) {
 
-  int gameIndex = -1;
+  tGame *game;
+  int seat;
+  uint64_t lsn;
 
   // Set \0 at the end of the string
   playerName.msg[playerName.__size] = 0;
 
-  if (DEBUG_SERVER)
-    printf("[Register] Registering new player -> [%s]\n", playerName.msg);
+  logEvent(logDebug, "[Register] Registering new player -> [%s]",
+           playerName.msg, 0, 0);
 
-  // Buscar huecos en juegos
-  for (int i = 0; i < MAX_GAMES && gameIndex == -1; i++) {
-    pthread_mutex_lock(&games[i].mutex);
+  // El nombre debe ser unico en todo el servidor, no solo en la cola
+  seat = addName(nameIndex, playerName.msg);
 
-    tGameState status = games[i].status;
+  if (seat == ERROR_NAME_REPEATED) {
+    *result = ERROR_NAME_REPEATED;
 
-    if (status == gameWaitingPlayer) {
-      // Comprobar si el nombre ya existe en este juego
-      if (strcmp(games[i].player1Name, playerName.msg) == 0) {
-        *result = ERROR_NAME_REPEATED;
-        pthread_mutex_unlock(&games[i].mutex);
+    logEvent(logWarning, "[Register] ERROR: Name already exists in a game",
+             NULL, 0, 0);
 
-        if (DEBUG_SERVER)
-          printf("[Register] ERROR: Name already exists in game %d\n", i);
+    return SOAP_OK;
+  }
 
-        return SOAP_OK;
-      } else {
-        // agregar como j2
-        strcpy(games[i].player2Name, playerName.msg);
-        gameIndex = i;
-
-        initDeck(&(games[i].gameDeck));
-        clearDeck(&(games[i].player1Deck));
-        clearDeck(&(games[i].player2Deck));
-        games[i].player1Bet = DEFAULT_BET;
-        games[i].player2Bet = DEFAULT_BET;
-        games[i].endOfGame = FALSE;
-
-        // Randomly select starting player
-        games[i].currentPlayer = (rand() % 2 == 0) ? player1 : player2;
-
-        // Deal initial cards (2 cards for each player)
-        for (int j = 0; j < 2; j++) {
-          unsigned int card1 = getRandomCard(&(games[i].gameDeck));
-          games[i].player1Deck.cards[games[i].player1Deck.__size++] = card1;
-
-          unsigned int card2 = getRandomCard(&(games[i].gameDeck));
-          games[i].player2Deck.cards[games[i].player2Deck.__size++] = card2;
-        }
-
-        // Desbloquear al otro jug y cambiar estado a ready.
-        games[i].status = gameReady;
-        pthread_cond_signal(&games[i].cond);
-        if (DEBUG_SERVER)
-          printf("[Register] Player %s registered in game %d as player2\n",
-                 playerName.msg, i);
-      }
-    } else if (status == gameEmpty) {
-      // agregar como j1
-      strcpy(games[i].player1Name, playerName.msg);
-      gameIndex = i;
-      games[i].status = gameWaitingPlayer;
-    }
-    pthread_mutex_unlock(&games[i].mutex);
+  // Buscar asiento en O(1); el juego se devuelve bloqueado. Si no hay
+  // asiento se borra el nombre (solo si se llego a anadir)
+  if (seat == 0) {
+    seat = seatPlayer(matchmaker, &game);
+    if (seat == ERROR_SERVER_FULL)
+      removeName(nameIndex, playerName.msg);
   }
-  // Comprobar si no hay huecos disponibles
-  if (gameIndex == -1) {
+
+  // Comprobar si no hay huecos disponibles (limite de memoria)
+  if (seat == ERROR_SERVER_FULL) {
     *result = ERROR_SERVER_FULL;
-    if (DEBUG_SERVER)
-      printf("[Register] ERROR: Server is full\n");
+
+    logEvent(logWarning, "[Register] ERROR: Server is full", NULL, 0, 0);
+
+    return SOAP_OK;
+  }
+
+  if (seat == player2) {
+
+    // agregar como j2
+    strcpy(game->player2Name, playerName.msg);
+    game->player2Nonce = newNonce(game);
+
+    initDeck(&(game->gameDeck));
+    shuffleDeck(&(game->gameDeck), &(game->rng));
+    clearDeck(&(game->player1Deck));
+    clearDeck(&(game->player2Deck));
+    clearScore(&(game->player1Score));
+    clearScore(&(game->player2Score));
+    game->player1Bet = DEFAULT_BET;
+    game->player2Bet = DEFAULT_BET;
+    game->endOfGame = FALSE;
+
+    // Randomly select starting player
+    game->currentPlayer = (nextRandom(&(game->rng)) & 1) ? player1 : player2;
+
+    // Deal initial cards (2 cards for each player)
+    for (int j = 0; j < 2; j++) {
+      dealCard(&(game->gameDeck), &(game->player1Deck), &(game->player1Score));
+      dealCard(&(game->gameDeck), &(game->player2Deck), &(game->player2Score));
+    }
+
+    // Desbloquear al otro jug (el unico que puede estar esperando) y cambiar
+    // estado a ready.
+    game->status = gameReady;
+    game->lastMove = nowSeconds();
+    wakePlayer(game, player1);
+
+    logEvent(logDebug, "[Register] Player %s registered in game %d as player2",
+             playerName.msg, game->id, 0);
   } else {
-    *result = gameIndex;
+    // agregar como j1
+    strcpy(game->player1Name, playerName.msg);
+    game->player1Nonce = newNonce(game);
+    game->status = gameWaitingPlayer;
   }
+
+  *result = game->id;
+
+  lsn = appendJournal(&journal, game,
+                      (seat == player2) ? journalDeal : journalRegister);
+  pthread_mutex_unlock(&game->mutex);
+
+  // Se encola ya con player1 dentro: quien lo saque lo encuentra esperando
+  if (seat == player1)
+    queueGame(matchmaker, game);
+
+  // No se confirma el asiento hasta que esta en disco
+  if (waitJournal(&journal, lsn) != 0)
+    return soap_receiver_fault(soap, "Cannot write the journal", NULL);
+
   return SOAP_OK;
 }
 
-int blackJackns__getStatus(struct soap *soap, blackJackns__tMessage playerName,
-                           int gameId, blackJackns__tBlock *status) {
-  // 1. comprobar que esta registrado
+/**
+ * Fills the status to be sent to a player, if there is something to report:
+ * the end of the game or the player's turn. The game mutex must be held.
+ *
+ * @return FALSE if the player has to keep waiting.
+ */
+static int fillStatus(struct soap *soap, tGame *game, tPlayer player,
+                      blackJackns__tBlock *status, int *finished) {
+
+  tHand *playerDeck;
+  tScore *playerScore, *rivalScore;
+
+  // Esperando al segundo jugador, o turno del rival
+  if (game->status == gameWaitingPlayer ||
+      (!game->endOfGame && game->currentPlayer != player))
+    return FALSE;
+
+  if (player == player1) {
+    playerDeck = &(game->player1Deck);
+    playerScore = &(game->player1Score);
+    rivalScore = &(game->player2Score);
+  } else {
+    playerDeck = &(game->player2Deck);
+    playerScore = &(game->player2Score);
+    rivalScore = &(game->player1Score);
+  }
 
-  char message[STRING_LENGTH];
-  tPlayer player;
-  blackJackns__tDeck *playerDeck, *rivalDeck;
+  // Comprobar si el juego ha terminado
+  if (game->endOfGame) {
+    unsigned int playerPoints = playerScore->points;
+    unsigned int rivalPoints = rivalScore->points;
 
-  playerName.msg[playerName.__size] = 0;
+    if (playerPoints > GOAL_GAME) {
+      copyGameStatusCode(soap, status, MSG_LOSE_OVER, GOAL_GAME, playerPoints,
+                         rivalPoints, playerDeck, GAME_LOSE);
+    } else if (rivalPoints > GOAL_GAME) {
+      copyGameStatusCode(soap, status, MSG_WIN_RIVAL_OVER, GOAL_GAME,
+                         playerPoints, rivalPoints, playerDeck, GAME_WIN);
+    } else if (playerPoints > rivalPoints) {
+      copyGameStatusCode(soap, status, MSG_WIN, playerPoints, rivalPoints, 0,
+                         playerDeck, GAME_WIN);
+    } else if (rivalPoints > playerPoints) {
+      copyGameStatusCode(soap, status, MSG_LOSE, playerPoints, rivalPoints, 0,
+                         playerDeck, GAME_LOSE);
+    } else {
+      copyGameStatusCode(soap, status, MSG_DRAW, playerPoints, rivalPoints, 0,
+                         playerDeck, GAME_LOSE);
+    }
+    // resetear juego al terminar (otras peticiones aparcadas ya no lo veran)
+    endGame(game);
+    *finished = TRUE;
+  } else {
+    // Es el turno de player.
+    unsigned int playerPoints = playerScore->points;
+    copyGameStatusCode(soap, status, MSG_YOUR_TURN, playerPoints, 0, 0,
+                       playerDeck, TURN_PLAY);
+  }
+
+  return TRUE;
+}
 
-  // Asignar memoria para el resultado (tBlock)
-  allocClearBlock(soap, status);
+/**
+ * Finds the seat of a player by name. On success the game is returned locked;
+ * otherwise the error is stored in status and NULL is returned.
+ */
+static tGame *lockSeatByName(struct soap *soap,
+                             blackJackns__tMessage playerName, int gameId,
+                             tPlayer *player, blackJackns__tBlock *status) {
+
+  tGame *game;
+
+  playerName.msg[playerName.__size] = 0;
 
   // Comprobar validez gameid
-  if (gameId < 0 || gameId >= MAX_GAMES) {
-    copyGameStatusStructure(status, "Invalid game ID", &(status->deck),
-                            ERROR_PLAYER_NOT_FOUND);
-    return SOAP_OK;
+  game = getGame(gameTable, gameId);
+  if (game == NULL) {
+    copyGameStatusCode(soap, status, MSG_INVALID_GAME, 0, 0, 0, NULL,
+                       ERROR_PLAYER_NOT_FOUND);
+    return NULL;
   }
 
-  pthread_mutex_lock(&games[gameId].mutex);
+  metricsLock(&game->mutex);
 
   // Check if player is registered
-  if (strcmp(games[gameId].player1Name, playerName.msg) == 0) {
-    player = player1;
-    playerDeck = &(games[gameId].player1Deck);
-    rivalDeck = &(games[gameId].player2Deck);
-  } else if (strcmp(games[gameId].player2Name, playerName.msg) == 0) {
-    player = player2;
-    playerDeck = &(games[gameId].player2Deck);
-    rivalDeck = &(games[gameId].player1Deck);
+  if (strcmp(game->player1Name, playerName.msg) == 0) {
+    *player = player1;
+  } else if (strcmp(game->player2Name, playerName.msg) == 0) {
+    *player = player2;
   } else {
     // Player not found
-    copyGameStatusStructure(status, "Player not found", &(status->deck),
-                            ERROR_PLAYER_NOT_FOUND);
-    pthread_mutex_unlock(&games[gameId].mutex);
+    copyGameStatusCode(soap, status, MSG_PLAYER_NOT_FOUND, 0, 0, 0, NULL,
+                       ERROR_PLAYER_NOT_FOUND);
+    pthread_mutex_unlock(&game->mutex);
 
-    if (DEBUG_SERVER)
-      printf("[GetStatus] ERROR: Player %s not found in game %d\n",
-             playerName.msg, gameId);
+    logEvent(logWarning, "[GetStatus] ERROR: Player %s not found in game %d",
+             playerName.msg, gameId, 0);
 
-    return SOAP_OK;
+    return NULL;
   }
 
-  // Wait while game is not ready (waiting for second player)
-  while (games[gameId].status == gameWaitingPlayer) {
+  return game;
+}
 
-    if (DEBUG_SERVER)
-      printf("[GetStatus] Player %s waiting for second player in game %d\n",
-             playerName.msg, gameId);
+/**
+ * Status of a seat, whose game is locked (and unlocked here). If it is not
+ * his turn, waits until it arrives.
+ */
+static int waitStatus(struct soap *soap, tGame *game, tPlayer player,
+                      blackJackns__tBlock *status) {
 
-    pthread_cond_wait(&games[gameId].cond, &games[gameId].mutex);
-  }
+  int finished = FALSE;
+  int gameId = game->id;
+  uint32_t nonce = seatNonce(game, player);
+  const char *playerName =
+      (player == player1) ? game->player1Name : game->player2Name;
 
   // 2. manejar turnos
-
-  // pthread_mutex_lock(&games[gameId].mutex);
-  // while (playerName.msg == games[gameId].player1Name &&
-  //            games[gameId].currentPlayer != player1 ||
-  //        playerName.msg == games[gameId].player2Name &&
-  //            games[gameId].currentPlayer != player2) {
-  //   pthread_cond_wait(&games[gameId].cond, &games[gameId].mutex);
-  // }
   //
   // Mientras no sea el turno del jugador (player), y no ha acabado el juego ->
   // Esperar
-  while (!games[gameId].endOfGame && games[gameId].currentPlayer != player) {
-    if (DEBUG_SERVER) {
-      printf("[GetStatus] Player %s waiting for turn in game %d\n",
-             playerName.msg, gameId);
+  while (!fillStatus(soap, game, player, status, &finished)) {
+
+    // En modo reactor no se bloquea el hilo: se aparca la peticion
+    if (soap->user != NULL) {
+      parkConnection(game, soap, player);
+
+      logEvent(logDebug, "[GetStatus] Player %s parked in game %d", playerName,
+               gameId, 0);
+
+      pthread_mutex_unlock(&game->mutex);
+      return SOAP_PARKED;
     }
-    pthread_cond_wait(&games[gameId].cond, &games[gameId].mutex);
-  }
 
-  // Comprobar si el juego ha terminado
-  if (games[gameId].endOfGame) {
-    unsigned int playerPoints = calculatePoints(playerDeck);
-    unsigned int rivalPoints = calculatePoints(rivalDeck);
+    // No bloquea ni reserva memoria, aunque se tenga el mutex del juego
+    if (game->status == gameWaitingPlayer)
+      logEvent(logDebug,
+               "[GetStatus] Player %s waiting for second player in game %d",
+               playerName, gameId, 0);
+    else
+      logEvent(logDebug, "[GetStatus] Player %s waiting for turn in game %d",
+               playerName, gameId, 0);
 
-    if (playerPoints > GOAL_GAME) {
-      sprintf(message,
-              "You lose! You went over %d points. Your points: %d, Rival "
-              "points: %d",
-              GOAL_GAME, playerPoints, rivalPoints);
-      copyGameStatusStructure(status, message, playerDeck, GAME_LOSE);
-    } else if (rivalPoints > GOAL_GAME) {
-      sprintf(message,
-              "You win! Rival went over %d points. Your points: %d, Rival "
-              "points: %d",
-              GOAL_GAME, playerPoints, rivalPoints);
-      copyGameStatusStructure(status, message, playerDeck, GAME_WIN);
-    } else if (playerPoints > rivalPoints) {
-      sprintf(message, "You win! Your points: %d, Rival points: %d",
-              playerPoints, rivalPoints);
-      copyGameStatusStructure(status, message, playerDeck, GAME_WIN);
-    } else if (rivalPoints > playerPoints) {
-      sprintf(message, "You lose! Your points: %d, Rival points: %d",
-              playerPoints, rivalPoints);
-      copyGameStatusStructure(status, message, playerDeck, GAME_LOSE);
-    } else {
-      sprintf(message, "Draw! Your points: %d, Rival points: %d", playerPoints,
-              rivalPoints);
-      copyGameStatusStructure(status, message, playerDeck, GAME_LOSE);
+    waitSharedCond((player == player1) ? &game->player1Cond
+                                       : &game->player2Cond,
+                   &game->mutex);
+
+    // Juego abandonado y reiniciado mientras esperaba: el asiento ya no es suyo
+    if (seatNonce(game, player) != nonce) {
+      copyGameStatusCode(soap, status, MSG_PLAYER_NOT_FOUND, 0, 0, 0, NULL,
+                         ERROR_PLAYER_NOT_FOUND);
+      break;
     }
-    // resetear juego al terminar.
-    initGame(&(games[gameId]));
-  } else {
-    // Es el turno de player.
-    unsigned int playerPoints = calculatePoints(playerDeck);
-    sprintf(message, "Your turn! Your points: %d", playerPoints);
-    copyGameStatusStructure(status, message, playerDeck, TURN_PLAY);
   }
 
-  pthread_mutex_unlock(&games[gameId].mutex);
+  // Si ha terminado, los nombres ya se han borrado (initGame)
+  if (finished)
+    logEvent(logDebug, "[GetStatus] End of game %d sent", NULL, gameId, 0);
+  else
+    logEvent(logDebug, "[GetStatus] Status sent to player %s in game %d",
+             playerName, gameId, 0);
+
+  pthread_mutex_unlock(&game->mutex);
 
-  if (DEBUG_SERVER)
-    printf("[GetStatus] Status sent to player %s in game %d\n", playerName.msg,
-           gameId);
+  // Devolver el juego (ya vacio) a la lista de libres
+  if (finished)
+    releaseGame(matchmaker, game);
 
   return SOAP_OK;
 }
 
-int blackJackns__playerMove(struct soap *soap, blackJackns__tMessage playerName,
-                            int gameId, int action,
-                            blackJackns__tBlock *result) {
-  // 1. comprobar que esta registrado
+static int getStatus(struct soap *soap, blackJackns__tMessage playerName,
+                     int gameId, blackJackns__tBlock *status) {
 
-  char message[STRING_LENGTH];
   tPlayer player;
-  blackJackns__tDeck *playerDeck, *rivalDeck;
-
-  playerName.msg[playerName.__size] = 0;
+  tGame *game;
 
-  // Asignar memoria para el resultado (tBlock)
-  allocClearBlock(soap, result);
+  // La memoria del resultado se reserva al copiarlo (segun su tamano)
+  soap_default_blackJackns__tBlock(soap, status);
 
-  // Comprobar validez gameid
-  if (gameId < 0 || gameId >= MAX_GAMES) {
-    copyGameStatusStructure(result, "Invalid game ID", &(result->deck),
-                            ERROR_PLAYER_NOT_FOUND);
+  game = lockSeatByName(soap, playerName, gameId, &player, status);
+  if (game == NULL)
     return SOAP_OK;
+
+  return waitStatus(soap, game, player, status);
+}
+
+/**
+ * Sends a getStatus response. Same steps as the generated
+ * soap_serve_blackJackns__getStatus, once the service has returned.
+ */
+static int sendStatusResponse(struct soap *soap, blackJackns__tBlock *status) {
+
+  struct blackJackns__getStatusResponse response;
+
+  soap_default_blackJackns__getStatusResponse(soap, &response);
+  response.result = status;
+
+  soap->encodingStyle = NULL; /* use SOAP literal style */
+  soap_serializeheader(soap);
+  soap_serialize_blackJackns__getStatusResponse(soap, &response);
+  if (soap_begin_count(soap))
+    return soap->error;
+  if ((soap->mode & SOAP_IO_LENGTH)) {
+    if (soap_envelope_begin_out(soap) || soap_putheader(soap) ||
+        soap_body_begin_out(soap) ||
+        soap_put_blackJackns__getStatusResponse(
+            soap, &response, "blackJackns:getStatusResponse", "") ||
+        soap_body_end_out(soap) || soap_envelope_end_out(soap))
+      return soap->error;
   }
+  if (soap_end_count(soap) || soap_response(soap, SOAP_OK) ||
+      soap_envelope_begin_out(soap) || soap_putheader(soap) ||
+      soap_body_begin_out(soap) ||
+      soap_put_blackJackns__getStatusResponse(
+          soap, &response, "blackJackns:getStatusResponse", "") ||
+      soap_body_end_out(soap) || soap_envelope_end_out(soap) ||
+      soap_end_send(soap))
+    return soap->error;
+  return soap_closesock(soap);
+}
 
-  pthread_mutex_lock(&games[gameId].mutex);
+int resumeGetStatus(struct soap *soap, int gameId, tPlayer player,
+                    uint32_t nonce) {
 
-  // Check if player is registered
-  if (strcmp(games[gameId].player1Name, playerName.msg) == 0) {
-    player = player1;
-    playerDeck = &(games[gameId].player1Deck);
-    rivalDeck = &(games[gameId].player2Deck);
-  } else if (strcmp(games[gameId].player2Name, playerName.msg) == 0) {
-    player = player2;
-    playerDeck = &(games[gameId].player2Deck);
-    rivalDeck = &(games[gameId].player1Deck);
-  } else {
-    // jug no encontrado
-    copyGameStatusStructure(result, "Player not found", &(result->deck),
-                            ERROR_PLAYER_NOT_FOUND);
-    pthread_mutex_unlock(&games[gameId].mutex);
+  blackJackns__tBlock status;
+  tGame *game = getGame(gameTable, gameId);
+  int finished = FALSE;
 
-    if (DEBUG_SERVER)
-      printf("[GetStatus] ERROR: Player %s not found in game %d\n",
-             playerName.msg, gameId);
+  soap_default_blackJackns__tBlock(soap, &status);
 
-    return SOAP_OK;
+  metricsLock(&game->mutex);
+
+  // El juego se ha reiniciado mientras estaba aparcado (y quizas lo ocupan
+  // otros jugadores): el asiento ya no es el suyo
+  if (seatNonce(game, player) != nonce) {
+    copyGameStatusCode(soap, &status, MSG_PLAYER_NOT_FOUND, 0, 0, 0, NULL,
+                       ERROR_PLAYER_NOT_FOUND);
+  } else if (!fillStatus(soap, game, player, &status, &finished)) {
+    parkConnection(game, soap, player);
+    pthread_mutex_unlock(&game->mutex);
+    return SOAP_PARKED;
+  }
+
+  pthread_mutex_unlock(&game->mutex);
+
+  if (finished)
+    releaseGame(matchmaker, game);
+
+  logEvent(logDebug, "[GetStatus] Parked status sent in game %d", NULL, gameId,
+           0);
+
+  return sendStatusResponse(soap, &status);
+}
+
+void cancelGetStatus(struct soap *soap, int gameId, tPlayer player) {
+
+  tGame *game = getGame(gameTable, gameId);
+
+  metricsLock(&game->mutex);
+  unparkConnection(game, soap, player);
+  pthread_mutex_unlock(&game->mutex);
+
+  logEvent(logDebug, "[GetStatus] Parked call closed by the client in game %d",
+           NULL, gameId, 0);
+}
+
+/**
+ * Move of a seat, whose game is locked (and unlocked here).
+ */
+static int applyMove(struct soap *soap, tGame *game, tPlayer player,
+                     int action, blackJackns__tBlock *result) {
+
+  tHand *playerDeck;
+  tScore *playerScore, *rivalScore;
+  int gameId = game->id;
+  const char *playerName;
+
+  if (player == player1) {
+    playerName = game->player1Name;
+    playerDeck = &(game->player1Deck);
+    playerScore = &(game->player1Score);
+    rivalScore = &(game->player2Score);
+  } else {
+    playerName = game->player2Name;
+    playerDeck = &(game->player2Deck);
+    playerScore = &(game->player2Score);
+    rivalScore = &(game->player1Score);
   }
 
-  // Comprobar si es el turno de este jugador (player)
-  if (games[gameId].currentPlayer != player) {
-    sprintf(message, "It's not your turn!");
-    copyGameStatusStructure(result, message, playerDeck, TURN_WAIT);
-    pthread_mutex_unlock(&games[gameId].mutex);
+  // Comprobar si es el turno de este jugador (player). Con la partida
+  // terminada (o sin empezar) no se acepta ninguna jugada
+  if (game->status != gameReady || game->endOfGame ||
+      game->currentPlayer != player) {
+    copyGameStatusCode(soap, result, MSG_NOT_YOUR_TURN, 0, 0, 0, playerDeck,
+                       TURN_WAIT);
+    pthread_mutex_unlock(&game->mutex);
     return SOAP_OK;
   }
 
-  if (DEBUG_SERVER)
-    printf("[PlayerMove] Player %s action: %d in game %d\n", playerName.msg,
-           action, gameId);
+  logEvent(logDebug, "[PlayerMove] Player %s action: %d in game %d",
+           playerName, action, gameId);
 
-  // Procesar accion
-  if (action == PLAYER_HIT_CARD) {
-    unsigned int card = getRandomCard(&(games[gameId].gameDeck));
-    playerDeck->cards[playerDeck->__size++] = card;
+  // Sin cartas en el mazo no se puede pedir: se planta
+  if (action == PLAYER_HIT_CARD &&
+      dealCard(&(game->gameDeck), playerDeck, playerScore) != 0)
+    action = PLAYER_STAND;
 
+  // Procesar accion (la carta ya esta repartida)
+  if (action == PLAYER_HIT_CARD) {
     // resetear flag de "se ha plantado", por claridad.
     if (player == player1)
-      games[gameId].player1Stood = FALSE;
+      game->player1Stood = FALSE;
     else
-      games[gameId].player2Stood = FALSE;
+      game->player2Stood = FALSE;
 
-    unsigned int playerPoints = calculatePoints(playerDeck);
+    unsigned int playerPoints = playerScore->points;
 
     if (playerPoints > GOAL_GAME) {
       // Player se pasa, pierde.
-      sprintf(message, "You went over %d! You lose. Your points: %d", GOAL_GAME,
-              playerPoints);
-      copyGameStatusStructure(result, message, playerDeck, GAME_LOSE);
-      games[gameId].endOfGame = TRUE;
+      copyGameStatusCode(soap, result, MSG_BUST, GOAL_GAME, playerPoints, 0,
+                         playerDeck, GAME_LOSE);
+      game->endOfGame = TRUE;
 
       // Desbloquear rival para notificar victoria
-      pthread_cond_signal(&games[gameId].cond);
+      wakeBothPlayers(game);
     } else if (playerPoints == GOAL_GAME) {
       // Player alcanza 21
-      sprintf(message, "You reached %d! You must stand. Your points: %d",
-              GOAL_GAME, playerPoints);
-      copyGameStatusStructure(result, message, playerDeck, TURN_PLAY);
+      copyGameStatusCode(soap, result, MSG_REACHED_GOAL, GOAL_GAME,
+                         playerPoints, 0, playerDeck, TURN_PLAY);
 
       // Cambiar turno
-      games[gameId].currentPlayer = calculateNextPlayer(player);
-      pthread_cond_signal(&games[gameId].cond);
+      game->currentPlayer = calculateNextPlayer(player);
+      wakePlayer(game, game->currentPlayer);
     } else {
       // Player continua
-      sprintf(message, "You drew a card. Your points: %d", playerPoints);
-      copyGameStatusStructure(result, message, playerDeck, TURN_PLAY);
+      copyGameStatusCode(soap, result, MSG_DREW_CARD, playerPoints, 0, 0,
+                         playerDeck, TURN_PLAY);
     }
   } else if (action == PLAYER_STAND) {
-    unsigned int playerPoints = calculatePoints(playerDeck);
-    unsigned int rivalPoints = calculatePoints(rivalDeck);
+    unsigned int playerPoints = playerScore->points;
+    unsigned int rivalPoints = rivalScore->points;
 
     // Marcar jugador actual como plantado
     if (player == player1)
-      games[gameId].player1Stood = TRUE;
+      game->player1Stood = TRUE;
     else
-      games[gameId].player2Stood = TRUE;
+      game->player2Stood = TRUE;
 
     // Si se han plantado los 2 -> resolver y terminar
-    if (games[gameId].player1Stood && games[gameId].player2Stood) {
+    if (game->player1Stood && game->player2Stood) {
       if (playerPoints > rivalPoints && playerPoints <= GOAL_GAME) {
-        sprintf(message, "You win! Your points: %d, Rival points: %d",
-                playerPoints, rivalPoints);
-        copyGameStatusStructure(result, message, playerDeck, GAME_WIN);
+        copyGameStatusCode(soap, result, MSG_WIN, playerPoints, rivalPoints,
+                           0, playerDeck, GAME_WIN);
       } else if (rivalPoints > playerPoints && rivalPoints <= GOAL_GAME) {
-        sprintf(message, "You lose! Your points: %d, Rival points: %d",
-                playerPoints, rivalPoints);
-        copyGameStatusStructure(result, message, playerDeck, GAME_LOSE);
+        copyGameStatusCode(soap, result, MSG_LOSE, playerPoints, rivalPoints,
+                           0, playerDeck, GAME_LOSE);
       } else {
-        sprintf(message, "Draw! Your points: %d, Rival points: %d",
-                playerPoints, rivalPoints);
-        copyGameStatusStructure(result, message, playerDeck, GAME_LOSE);
+        copyGameStatusCode(soap, result, MSG_DRAW, playerPoints, rivalPoints,
+                           0, playerDeck, GAME_LOSE);
       }
-      games[gameId].endOfGame = TRUE;
-      pthread_cond_signal(&games[gameId].cond);
+      game->endOfGame = TRUE;
+      wakeBothPlayers(game);
     } else {
       // Cambiar turno
-      sprintf(message, "You stand with %d points. Rival's turn now.",
-              playerPoints);
-      copyGameStatusStructure(result, message, playerDeck, TURN_WAIT);
-      games[gameId].currentPlayer = calculateNextPlayer(player);
-      pthread_cond_signal(&games[gameId].cond);
+      copyGameStatusCode(soap, result, MSG_STAND, playerPoints, 0, 0,
+                         playerDeck, TURN_WAIT);
+      game->currentPlayer = calculateNextPlayer(player);
+      wakePlayer(game, game->currentPlayer);
     }
   }
 
-  pthread_mutex_unlock(&games[gameId].mutex);
+  // Se escribe con el juego bloqueado (orden); se espera en syncMoves
+  if (action == PLAYER_HIT_CARD || action == PLAYER_STAND) {
+    game->lastMove = nowSeconds();
+    moveLsn = appendJournal(&journal, game,
+                            (action == PLAYER_HIT_CARD) ? journalHit
+                                                        : journalStand);
+  }
+
+  logEvent(logDebug, "[PlayerMove] Move processed for player %s in game %d",
+           playerName, gameId, 0);
+
+  pthread_mutex_unlock(&game->mutex);
+
+  return SOAP_OK;
+}
+
+/**
+ * Waits until the moves served by this thread are on disk.
+ *
+ * @return SOAP_OK, or a fault if the journal failed before writing them (the
+ * moves must not be confirmed).
+ */
+static int syncMoves(struct soap *soap) {
+
+  uint64_t lsn = moveLsn;
 
-  if (DEBUG_SERVER)
-    printf("[PlayerMove] Move processed for player %s in game %d\n",
-           playerName.msg, gameId);
+  moveLsn = 0;
+  if (waitJournal(&journal, lsn) != 0)
+    return soap_receiver_fault(soap, "Cannot write the journal", NULL);
 
   return SOAP_OK;
 }
+
+static int playerMove(struct soap *soap, blackJackns__tMessage playerName,
+                      int gameId, int action, blackJackns__tBlock *result) {
+
+  tPlayer player;
+  tGame *game;
+
+  // La memoria del resultado se reserva al copiarlo (segun su tamano)
+  soap_default_blackJackns__tBlock(soap, result);
+
+  game = lockSeatByName(soap, playerName, gameId, &player, result);
+  if (game == NULL)
+    return SOAP_OK;
+
+  return applyMove(soap, game, player, action, result);
+}
+
+int blackJackns__register(struct soap *soap, blackJackns__tMessage playerName,
+                          int *result) {
+
+  unsigned long long start = metricsNow();
+  int error = registerPlayer(soap, playerName, result);
+
+  metricsRecordRpc(metricsRegister, start);
+  return error;
+}
+
+int blackJackns__getStatus(struct soap *soap, blackJackns__tMessage playerName,
+                           int gameId, blackJackns__tBlock *status) {
+
+  unsigned long long start = metricsNow();
+  int error = getStatus(soap, playerName, gameId, status);
+
+  // Un getStatus aparcado se mide cuando se envia (serveConnection)
+  if (error != SOAP_PARKED)
+    metricsRecordRpc(metricsGetStatus, start);
+  return error;
+}
+
+int blackJackns__playerMove(struct soap *soap, blackJackns__tMessage playerName,
+                            int gameId, int action,
+                            blackJackns__tBlock *result) {
+
+  unsigned long long start = metricsNow();
+  int error = playerMove(soap, playerName, gameId, action, result);
+
+  if (syncMoves(soap) != SOAP_OK)
+    error = soap->error;
+  metricsRecordRpc(metricsPlayerMove, start);
+  return error;
+}
+
+/**
+ * Reports the current log level with GET /log-level. The level can only be
+ * changed (GET /log-level?level) by a client on this host: the port has no
+ * authentication.
+ */
+static int serveLogLevel(struct soap *soap) {
+
+  char *query = strchr(soap->path, '?');
+  int level;
+
+  if (query != NULL) {
+
+    // Solo desde 127.0.0.0/8 (soap->ip esta en orden de host)
+    if ((soap->ip >> 24) != 127) {
+      logEvent(logWarning, "[Log] Remote change of the log level refused",
+               NULL, 0, 0);
+      return 403;
+    }
+
+    level = parseLogLevel(query + 1);
+    if (level >= 0)
+      setLogLevel(level);
+  }
+
+  soap->http_content = "text/plain";
+  if (soap_response(soap, SOAP_FILE) || soap_send(soap, "log level: ") ||
+      soap_send(soap, logLevelName(getLogLevel())) || soap_send(soap, "\n"))
+    return soap->error;
+
+  return soap_end_send(soap);
+}
+
+/**
+ * Handler of HTTP GET requests (fget callback): serves the metrics and the
+ * log level.
+ */
+static int serveHttpGet(struct soap *soap) {
+
+  tMetricsGauges gauges;
+
+  if (strncmp(soap->path, LOG_LEVEL_PATH, strlen(LOG_LEVEL_PATH)) == 0)
+    return serveLogLevel(soap);
+
+  if (strcmp(soap->path, METRICS_PATH) != 0)
+    return SOAP_GET_METHOD;
+
+  // Lecturas sin bloquear: solo es una foto aproximada
+  gauges.queueDepth =
+      __atomic_load_n(&(workerPool.queue.count), __ATOMIC_RELAXED);
+  for (int i = 0; acceptors != NULL && i < numAcceptors; i++)
+    gauges.queueDepth +=
+        __atomic_load_n(&(acceptors[i].pool.queue.count), __ATOMIC_RELAXED);
+  gauges.activeGames =
+      __atomic_load_n(&(matchmaker->numPlaying), __ATOMIC_RELAXED);
+  gauges.waitingPlayers =
+      __atomic_load_n(&(matchmaker->numWaiting), __ATOMIC_RELAXED);
+  gauges.recoverySeconds = journal.recoveryNs / 1e9;
+
+  return sendMetrics(soap, &gauges);
+}
+
+/**
+ * Starts numAcceptors acceptors on the same port. Workers and queue slots are
+ * split among them (the first ones take the remainder), so the totals are the
+ * configured ones. If any of them fails, the error is printed and the ones
+ * already created are stopped.
+ */
+static int startAcceptors(struct soap *master, int port, int backlog,
+                          int numWorkers, int queueSize) {
+
+  int workers, slots, created, started = 0;
+
+  acceptors = (tAcceptor *)calloc(numAcceptors, sizeof(tAcceptor));
+  if (acceptors == NULL)
+    return -1;
+
+  // Primero todos los sockets y workers; solo entonces se acepta
+  for (created = 0; created < numAcceptors; created++) {
+    workers = numWorkers / numAcceptors + (created < numWorkers % numAcceptors);
+    slots = queueSize / numAcceptors + (created < queueSize % numAcceptors);
+
+    if (initAcceptor(&(acceptors[created]), master, created, port, backlog,
+                     workers, slots) != 0) {
+      printf("Error creating acceptor %d on port %d (%d workers, queue size "
+             "%d)\n",
+             created, port, workers, slots);
+      break;
+    }
+  }
+
+  while (created == numAcceptors && started < numAcceptors &&
+         startAcceptor(&(acceptors[started])) == 0)
+    started++;
+
+  if (started == numAcceptors)
+    return 0;
+
+  if (created == numAcceptors)
+    printf("Error starting the thread of acceptor %d\n", started);
+
+  for (int i = 0; i < created; i++)
+    stopAcceptor(&(acceptors[i]), i < started);
+
+  free(acceptors);
+  acceptors = NULL;
+  return -1;
+}
+
+static void printUsage(const char *program) {
+  printf("Usage: %s [--workers n] [--queue n] [--max-memory MB] [--reactor] "
+         "[--binary-port port] [--log-level error|warning|info|debug] "
+         "[--journal dir | --shared name] [--acceptors n] [--backlog n] "
+         "port\n",
+         program);
+}
+
 int main(int argc, char **argv) {
 
   struct soap soap;
-  struct soap *tsoap;
-  pthread_t tid;
-  int port;
+  tReactor reactor;
+  tBinaryListener binaryListener;
+  int port, opt, binaryPort = 0;
+  int logLevel = DEFAULT_LOG_LEVEL;
+  int reactorMode = FALSE;
+  int numWorkers = DEFAULT_WORKERS;
+  int queueSize = DEFAULT_QUEUE_SIZE;
+  int maxMemoryMB = DEFAULT_MAX_MEMORY_MB;
+  int backlog = DEFAULT_BACKLOG;
+  const char *journalDir = NULL;
+  const char *sharedName = NULL;
+  tWorkerPool *binaryPool = &workerPool;
   SOAP_SOCKET m, s;
 
+  static struct option longOptions[] = {
+      {"workers", required_argument, NULL, 'w'},
+      {"queue", required_argument, NULL, 'q'},
+      {"max-memory", required_argument, NULL, 'm'},
+      {"reactor", no_argument, NULL, 'r'},
+      {"binary-port", required_argument, NULL, 'b'},
+      {"log-level", required_argument, NULL, 'l'},
+      {"journal", required_argument, NULL, 'j'},
+      {"shared", required_argument, NULL, 's'},
+      {"acceptors", required_argument, NULL, 'a'},
+      {"backlog", required_argument, NULL, 'k'},
+      {NULL, 0, NULL, 0}};
+
   // Check arguments
-  if (argc != 2) {
-    printf("Usage: %s port\n", argv[0]);
+  while ((opt = getopt_long(argc, argv, "w:q:m:rb:l:j:s:a:k:", longOptions,
+                            NULL)) != -1) {
+    switch (opt) {
+    case 'w':
+      numWorkers = atoi(optarg);
+      break;
+    case 'q':
+      queueSize = atoi(optarg);
+      break;
+    case 'm':
+      maxMemoryMB = atoi(optarg);
+      break;
+    case 'r':
+      reactorMode = TRUE;
+      break;
+    case 'b':
+      binaryPort = atoi(optarg);
+      break;
+    case 'l':
+      logLevel = parseLogLevel(optarg);
+      break;
+    case 'j':
+      journalDir = optarg;
+      break;
+    case 's':
+      sharedName = optarg;
+      break;
+    case 'a':
+      numAcceptors = atoi(optarg);
+      break;
+    case 'k':
+      backlog = atoi(optarg);
+      break;
+    default:
+      printUsage(argv[0]);
+      exit(0);
+    }
+  }
+
+  if (optind != argc - 1 || numWorkers <= 0 || queueSize <= 0 ||
+      logLevel < 0 || numAcceptors <= 0 || backlog <= 0) {
+    printUsage(argv[0]);
     exit(0);
   }
 
+  // Los getStatus aparcados y el journal son de un solo proceso
+  if (sharedName != NULL && (reactorMode || journalDir != NULL)) {
+    printf("--shared cannot be used with --reactor nor --journal\n");
+    exit(0);
+  }
+
+  // El reactor reparte todas las conexiones desde un solo epoll
+  if (numAcceptors > 1 && reactorMode) {
+    printf("--acceptors cannot be used with --reactor\n");
+    exit(0);
+  }
+
+  // Cada aceptador necesita al menos un worker y un hueco en su cola
+  if (numAcceptors > numWorkers || numAcceptors > queueSize) {
+    printf("--acceptors cannot be greater than --workers nor --queue\n");
+    exit(0);
+  }
+
+  // Logs are written by a background thread
+  if (initLogger(logLevel) != 0) {
+    printf("Error starting the logger!\n");
+    exit(1);
+  }
+
   // Init soap and server environment
   soap_init(&soap);
-  initServerStructures(&soap);
+
+  switch (initServerStructures(maxMemoryMB, journalDir, sharedName)) {
+  case 0:
+    break;
+  case -2:
+    printf("Error recovering the journal in %s\n", journalDir);
+    exit(1);
+  case -3:
+    printf("Error mapping the shared memory %s\n", sharedName);
+    exit(1);
+  default:
+    printf("Error initializing the game table (max memory %d MB)\n",
+           maxMemoryMB);
+    exit(1);
+  }
+
+  if (journalDir != NULL)
+    printf("Recovered %d games (%d journal records) in %.1f ms\n",
+           journal.recoveredGames, journal.replayedRecords,
+           journal.recoveryNs / 1e6);
 
   // Configure timeouts
   soap.send_timeout = 60;     // 60 seconds
@@ -507,17 +1296,76 @@ int main(int argc, char **argv) {
   soap.accept_timeout = 3600; // server stops after 1 hour of inactivity
   soap.max_keep_alive = 100;  // max keep-alive sequence
 
+  // GET /metrics (the workers copy the callback with the context)
+  soap.fget = serveHttpGet;
+
   // Get listening port
-  port = atoi(argv[1]);
+  port = atoi(argv[optind]);
+
+  // Con --shared, varios procesos escuchan en el mismo puerto
+  if (sharedName != NULL)
+    soap.bind_flags = SO_REUSEPORT;
 
-  // Bind
-  m = soap_bind(&soap, NULL, port, 100);
+  // Varios aceptadores: cada uno con su socket (SO_REUSEPORT) y sus workers
+  if (numAcceptors > 1) {
+    if (startAcceptors(&soap, port, backlog, numWorkers, queueSize) != 0) {
+      printf("Error starting the acceptors!\n");
+      exit(1);
+    }
+    binaryPool = &(acceptors[0].pool);
+  } else {
 
-  if (!soap_valid_socket(m)) {
+    // Bind
+    m = soap_bind(&soap, NULL, port, backlog);
+
+    if (!soap_valid_socket(m)) {
+      exit(1);
+    }
+
+    // Spawn the workers (each one reuses its own copy of the soap context).
+    // In reactor mode, each job is one request of a connection watched by
+    // epoll
+    if (initWorkerPool(&workerPool, &soap, numWorkers, queueSize,
+                       reactorMode ? serveConnection : NULL) != 0) {
+      printf("Error creating the worker pool!\n");
+      exit(1);
+    }
+
+    if (reactorMode && initReactor(&reactor, &soap, &workerPool) != 0) {
+      printf("Error creating the reactor!\n");
+      exit(1);
+    }
+  }
+
+  // Binary protocol: its connections are served by the same workers, one
+  // worker per connection (also in reactor mode, see binary.h)
+  if (binaryPort > 0 &&
+      initBinaryListener(&binaryListener, binaryPort, backlog,
+                         sharedName != NULL, binaryPool) != 0) {
+    printf("Error binding the binary port %d!\n", binaryPort);
     exit(1);
   }
 
-  printf("Server is ON! Listening on port %d\n", port);
+  printf("Server is ON! Listening on port %d (%d workers, queue size %d%s)\n",
+         port, numWorkers, queueSize, reactorMode ? ", reactor" : "");
+
+  if (binaryPort > 0)
+    printf("Binary protocol on port %d\n", binaryPort);
+
+  if (sharedName != NULL)
+    printf("Games shared with the other processes of %s\n", sharedName);
+
+  // Cada aceptador tiene su propio bucle: este hilo solo espera
+  if (numAcceptors > 1) {
+    printf("%d acceptors on port %d (backlog %d)\n", numAcceptors, port,
+           backlog);
+
+    for (int i = 0; i < numAcceptors; i++)
+      pthread_join(acceptors[i].thread, NULL);
+
+    soap_done(&soap);
+    return 0;
+  }
 
   while (TRUE) {
 
@@ -536,20 +1384,18 @@ int main(int argc, char **argv) {
       break;
     }
 
-    // Copy the SOAP environment
-    tsoap = soap_copy(&soap);
-
-    if (!tsoap) {
-      printf("SOAP copy error!\n");
-      break;
-    }
-
-    // Create a new thread to process the request
-    pthread_create(&tid, NULL, (void *(*)(void *))processRequest,
-                   (void *)tsoap);
+    // Hand the socket to a worker (blocks while the queue is full), or let
+    // the reactor watch it
+    if (reactorMode)
+      addConnection(&reactor, s);
+    else
+      enqueueSocket(&workerPool, s);
   }
 
-  // Detach SOAP environment
+  // Wait for the workers (the reactor keeps feeding them until exit) and
+  // detach SOAP environment
+  if (!reactorMode)
+    stopWorkerPool(&workerPool);
   soap_done(&soap);
   return 0;
 }
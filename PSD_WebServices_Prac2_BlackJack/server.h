@@ -1,13 +1,13 @@
-#include "blackJackns.nsmap"
+#ifndef SERVER_H
+#define SERVER_H
+
 #include "game.h"
+#include "metrics.h"
+#include "rng.h"
 #include "soapH.h"
 #include <pthread.h>
-
-/** Flag to enable debugging */
-#define DEBUG_SERVER 1
-
-/** Maximum number of active games in the server */
-#define MAX_GAMES 5
+#include <stddef.h>
+#include <stdint.h>
 
 /** Initial stack for each player */
 #define INITIAL_STACK 1
@@ -21,8 +21,23 @@
 /** Value of a figure */
 #define FIGURE_VALUE 10
 
-/** Code to represents an empty card (in the deck) */
-#define UNSET_CARD 100
+/** Extra points of an ace that counts 11 */
+#define SOFT_ACE_BONUS 10
+
+/** Returned by getRandomCard when the deck is empty */
+#define NO_CARD DECK_SIZE
+
+/** Mask of the nonce of a seat */
+#define SEAT_NONCE_MASK 0x7FFFFFFFU
+
+/** Time without moves after which a game is abandoned and reset (seconds) */
+#define GAME_IDLE_TIMEOUT 300
+
+/** Interval between two searches of abandoned games (seconds) */
+#define GAME_REAP_INTERVAL 10
+
+/** Returned by getStatus when the request is parked (reactor mode) */
+#define SOAP_PARKED (SOAP_STOP + 100)
 
 /** Type for game status */
 typedef enum { gameEmpty, gameWaitingPlayer, gameReady } tGameState;
@@ -30,34 +45,98 @@ typedef enum { gameEmpty, gameWaitingPlayer, gameReady } tGameState;
 /** Players */
 typedef enum players { player1, player2 } tPlayer;
 
+/** Set of cards: bit i is set if card i is in the set */
+typedef uint64_t tCardMask;
+
+/** Set with the DECK_SIZE cards */
+#define FULL_DECK_MASK ((((tCardMask)1) << DECK_SIZE) - 1)
+
 /**
- * Struct that contains a game for 2 players
+ * Compact deck used inside the server: one byte per card, in order, and the
+ * set of cards in it. It is converted to blackJackns__tDeck only to be sent
+ * (see copyGameStatusCode), so clearing it just resets the size and the mask.
  */
-typedef struct game {
+typedef struct hand {
 
-  tPlayer currentPlayer; /** Current player */
+  uint8_t cards[DECK_SIZE]; /** Cards (only the first size are valid) */
+  uint8_t size;             /** Number of cards */
+  tCardMask mask;           /** Cards in this deck */
+} tHand;
 
-  xsd__string player1Name;        /** Name of player 1 */
-  blackJackns__tDeck player1Deck; /** Player1's deck */
-  unsigned int player1Bet;        /** Player1's bet */
-  unsigned int player1Stack;      /** Player1's stack */
+/**
+ * Memory of the message and the cards of a response. Each thread has one,
+ * reused by all the requests it serves (the response is sent before the next
+ * request is read).
+ */
+typedef struct responseBlock {
 
-  xsd__string player2Name;        /** Name of player 2 */
-  blackJackns__tDeck player2Deck; /** Player2's deck */
-  unsigned int player2Bet;        /** Player2's bet */
-  unsigned int player2Stack;      /** Player2's stack */
+  char msg[STRING_LENGTH];       /** Message (text or packed template) */
+  unsigned int cards[DECK_SIZE]; /** Cards of the hand */
+} tResponseBlock;
 
-  blackJackns__tDeck gameDeck; /** Main deck */
-  int endOfGame;               /** Flag to control the end of the game */
-  tGameState status;           /** Flag to indicate the status of this game */
+/**
+ * Running score of a hand, updated in O(1) each time a card is dealt
+ */
+typedef struct score {
+
+  uint8_t points; /** Points of the hand (aces count 1) */
+  uint8_t aces;   /** Aces in the hand (one of them could count 11) */
+} tScore;
 
+/**
+ * Struct that contains a game for 2 players. The fields used by every request
+ * fill the first cache line; the rest of the record starts on its own lines.
+ * Games are aligned to cache lines, so two games never share one.
+ */
+typedef struct game {
+
+  // Hot: mutex and state of the game (one cache line)
   pthread_mutex_t mutex;
-  pthread_cond_t cond;
+  tPlayer currentPlayer; /** Current player */
+  tGameState status;     /** Flag to indicate the status of this game */
+  int endOfGame;         /** Flag to control the end of the game */
 
   // Flags que indican si los jugadores han hecho STAND.
   int player1Stood;
   int player2Stood;
-} tGame;
+
+  tScore player1Score; /** Score of player1's deck */
+  tScore player2Score; /** Score of player2's deck */
+
+  // Warm: used only to wait for a turn and to wake the players up
+  pthread_cond_t player1Cond
+      __attribute__((aligned(CACHE_LINE_SIZE))); /** Player1 waits here */
+  pthread_cond_t player2Cond;                    /** Player2 waits here */
+  struct connection *player1Parked; /** Player1's parked getStatus calls */
+  struct connection *player2Parked; /** Player2's parked getStatus calls */
+  uint32_t lastMove; /** When the last move was made (seconds, monotonic) */
+
+  // Cold: names, decks and data used only at the start of a game
+  int id __attribute__((aligned(CACHE_LINE_SIZE))); /** Id in the table */
+  int next; /** Next game in the matchmaking list this game belongs to */
+
+  xsd__string player1Name;   /** Name of player 1 */
+  unsigned int player1Bet;   /** Player1's bet */
+  unsigned int player1Stack; /** Player1's stack */
+  uint32_t player1Nonce;     /** Nonce of player1's seat (0: no player) */
+
+  xsd__string player2Name;   /** Name of player 2 */
+  unsigned int player2Bet;   /** Player2's bet */
+  unsigned int player2Stack; /** Player2's stack */
+  uint32_t player2Nonce;     /** Nonce of player2's seat (0: no player) */
+
+  tRng rng;          /** Random numbers of this game */
+  tHand player1Deck; /** Player1's deck */
+  tHand player2Deck; /** Player2's deck */
+  tHand gameDeck;    /** Main deck (shuffled) */
+} __attribute__((aligned(CACHE_LINE_SIZE))) tGame;
+
+_Static_assert(offsetof(tGame, player1Cond) == CACHE_LINE_SIZE,
+               "the hot fields of tGame must fit in one cache line");
+_Static_assert(offsetof(tGame, id) % CACHE_LINE_SIZE == 0,
+               "the cold fields of tGame must start on a cache line");
+_Static_assert(sizeof(tGame) % CACHE_LINE_SIZE == 0,
+               "games must not share cache lines");
 
 /**
  * Initializes a game
@@ -65,14 +144,25 @@ typedef struct game {
  * @param game Game to be initialized.
  */
 void initGame(tGame *game);
-void initGameSyncPrimitives(tGame *game); // init mutex/cond (una vez)
+void initGameSyncPrimitives(tGame *game); // init mutex/conds (una vez)
+void initGameRng(tGame *game);            // seed del generador (una vez)
 
 /**
- * Initialize server structures and alloc memory.
+ * Initialize server structures. Games are allocated on demand. With a
+ * journal, the games of the previous run are restored first. With a shared
+ * segment, the structures are created by the first process and used by all
+ * the processes attached to it. A background thread resets the games
+ * abandoned for GAME_IDLE_TIMEOUT.
  *
- * @param soap Soap context.
+ * @param maxMemoryMB Hard memory limit for the games and the names of the
+ * players (in MB).
+ * @param journalDir Directory of the journal, or NULL to run without one.
+ * @param sharedName Name of the shared memory segment, or NULL.
+ * @return 0 on success, -1 on error, -2 if the journal cannot be recovered,
+ * -3 if the shared segment cannot be mapped.
  */
-void initServerStructures(struct soap *soap);
+int initServerStructures(int maxMemoryMB, const char *journalDir,
+                         const char *sharedName);
 
 /**
  * Inits the game deck with all the cards.
@@ -80,14 +170,22 @@ void initServerStructures(struct soap *soap);
  * @param deck Game deck.
  *
  */
-void initDeck(blackJackns__tDeck *deck);
+void initDeck(tHand *deck);
+
+/**
+ * Shuffles a deck (Fisher-Yates), so cards can be drawn from its end.
+ *
+ * @param deck Deck to be shuffled.
+ * @param rng Random number generator of the game.
+ */
+void shuffleDeck(tHand *deck, tRng *rng);
 
 /**
  * Clears a deck (for players)
  *
  * @param deck Player deck.
  */
-void clearDeck(blackJackns__tDeck *deck);
+void clearDeck(tHand *deck);
 
 /**
  * Calculates the next player
@@ -99,15 +197,51 @@ tPlayer calculateNextPlayer(tPlayer currentPlayer);
 
 /**
  * Gets a random card from the game deck. The obtained card is removed from the
- * game deck.
+ * game deck. The deck must have been shuffled, so this takes the last card in
+ * O(1).
  *
  * @param deck Deck where the card is removed from.
- * @return Randomly selected card from the deck.
+ * @return Randomly selected card from the deck, or NO_CARD if it is empty.
+ */
+unsigned int getRandomCard(tHand *deck);
+
+/**
+ * Deals a card from the game deck to a player, and updates his score.
+ *
+ * @param gameDeck Game deck (shuffled).
+ * @param deck Player's deck.
+ * @param score Player's score.
+ * @return 0, or -1 if the game deck is empty (nothing is dealt).
  */
-unsigned int getRandomCard(blackJackns__tDeck *deck);
+int dealCard(tHand *gameDeck, tHand *deck, tScore *score);
 
 /**
- * Calculates the current points of a given deck.
+ * Checks if a card is in a deck, in O(1).
+ *
+ * @param deck Deck.
+ * @param card Card.
+ * @return TRUE if the card is in the deck.
+ */
+int deckHasCard(tHand *deck, unsigned int card);
+
+/**
+ * Clears a score (empty deck).
+ *
+ * @param score Score to be cleared.
+ */
+void clearScore(tScore *score);
+
+/**
+ * Points of a hand if one of its aces counts 11 (real blackjack rules), as
+ * long as that does not bust the hand.
+ *
+ * @param score Score of the hand.
+ * @return Best points of the hand.
+ */
+unsigned int softPoints(tScore *score);
+
+/**
+ * Calculates the current points of a given deck (as received by a client).
  *
  * @param deck Given deck.
  * @return Points of the deck.
@@ -124,3 +258,78 @@ unsigned int calculatePoints(blackJackns__tDeck *deck);
  */
 void copyGameStatusStructure(blackJackns__tBlock *status, char *message,
                              blackJackns__tDeck *newDeck, int newCode);
+
+/**
+ * Fills a response block in place, and points the status at it: nothing is
+ * allocated. This is where the compact deck is converted to
+ * blackJackns__tDeck.
+ *
+ * @param status Structure to be sent.
+ * @param block Block where the message and the cards are written.
+ * @param codes TRUE to send only the id of the template and its arguments.
+ * @param msgId Id of the template (see messages.h).
+ * @param arg0 First argument of the template.
+ * @param arg1 Second argument of the template.
+ * @param arg2 Third argument of the template.
+ * @param newDeck Deck to be sent, or NULL to send no cards.
+ * @param newCode Code to be sent.
+ */
+void copyGameStatusBlock(blackJackns__tBlock *status, tResponseBlock *block,
+                         int codes, int msgId, int arg0, int arg1, int arg2,
+                         tHand *newDeck, int newCode);
+
+/**
+ * Copies the data to be sent in a blackJackns__tBlock structure, with the
+ * message given as a template of the catalog (see messages.h). The response
+ * block of the calling thread is filled (see copyGameStatusBlock), so the
+ * two hottest RPCs do not allocate. If the client has opted in, only the
+ * template id and its arguments are sent.
+ *
+ * @param soap Soap context of the request.
+ * @param status Structure where the data is copied.
+ * @param msgId Id of the template.
+ * @param arg0 First argument of the template.
+ * @param arg1 Second argument of the template.
+ * @param arg2 Third argument of the template.
+ * @param newDeck Deck to be sent, or NULL to send no cards.
+ * @param newCode Code to be sent.
+ */
+void copyGameStatusCode(struct soap *soap, blackJackns__tBlock *status,
+                        int msgId, int arg0, int arg1, int arg2,
+                        tHand *newDeck, int newCode);
+
+/**
+ * Checks if the client of the current request has opted in to receive message
+ * codes instead of texts (requests to MSG_CODES_PATH).
+ *
+ * @param soap Soap context of the request.
+ * @return TRUE if the messages must be sent as codes.
+ */
+int wantsMessageCodes(struct soap *soap);
+
+/**
+ * Finishes a getStatus that was parked (reactor mode): if there is something
+ * to report the response is sent, otherwise the request is parked again.
+ *
+ * @param soap Soap context of the connection.
+ * @param gameId Game of the parked getStatus.
+ * @param player Player of the parked getStatus.
+ * @param nonce Nonce of the seat when the call was parked. If the seat has
+ * changed since then (the game was reset, and maybe reseated), the player is
+ * reported as not found.
+ * @return SOAP_OK, SOAP_PARKED, or the soap error.
+ */
+int resumeGetStatus(struct soap *soap, int gameId, tPlayer player,
+                    uint32_t nonce);
+
+/**
+ * Drops a getStatus that was parked (reactor mode) because the client has
+ * closed the connection: it is taken out of the list of its game.
+ *
+ * @param soap Soap context of the connection.
+ * @param gameId Game of the parked getStatus.
+ * @param player Player of the parked getStatus.
+ */
+void cancelGetStatus(struct soap *soap, int gameId, tPlayer player);
+
+#endif
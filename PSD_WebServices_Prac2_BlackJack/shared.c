@@ -0,0 +1,213 @@
+#include "shared.h"
+#include "logger.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+/** TRUE if the sync primitives must work across processes */
+static int processShared = FALSE;
+
+/** Segment being initialized by this process (locked until it is published) */
+static int creatorFd = -1;
+
+/** State and name of the segment in use (NULL without --shared) */
+static tSharedState *attachedState = NULL;
+static const char *attachedName;
+
+/**
+ * Opens a segment, creating it if it does not exist, and locks it. Only the
+ * process that holds the lock can be initializing the segment; if it dies
+ * before publishing it, the kernel releases the lock and the next process
+ * finds it unpublished.
+ *
+ * @return The descriptor (locked), or -1 on error.
+ */
+static int lockSegment(const char *name, struct stat *info) {
+
+  int fd;
+
+  while (TRUE) {
+    fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+      return -1;
+
+    if (flock(fd, LOCK_EX) != 0 || fstat(fd, info) != 0) {
+      close(fd);
+      return -1;
+    }
+
+    // Su creador fallo y lo borro mientras se esperaba: abrir el siguiente
+    if (info->st_nlink > 0)
+      return fd;
+
+    close(fd);
+  }
+}
+
+/**
+ * Checks whether the state of a segment has been published.
+ */
+static int isPublished(int fd, struct stat *info) {
+
+  uint32_t magic = 0;
+
+  if (info->st_size < (off_t)sizeof(tSharedState))
+    return FALSE;
+
+  return pread(fd, &magic, sizeof(magic), offsetof(tSharedState, magic)) ==
+             sizeof(magic) &&
+         magic == SHARED_MAGIC;
+}
+
+tSharedState *attachSharedState(const char *name, size_t regionSize,
+                                int *created) {
+
+  tSharedState *state;
+  struct stat info;
+  size_t offset = (sizeof(tSharedState) + SLAB_ALIGNMENT - 1) &
+                  ~((size_t)SLAB_ALIGNMENT - 1);
+  size_t size = offset + regionSize;
+  void *base;
+  int fd = lockSegment(name, &info);
+
+  if (fd < 0)
+    return NULL;
+
+  *created = !isPublished(fd, &info);
+
+  if (*created) {
+    // Restos de un creador que murio a medias: se descartan (y quedan a cero)
+    if (info.st_size > 0)
+      logEvent(logWarning,
+               "[Shared] Segment %s was never published, recreating it", name,
+               0, 0);
+
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+      close(fd);
+      return NULL;
+    }
+  } else {
+    // Ya esta listo: los demas no necesitan el cerrojo
+    flock(fd, LOCK_UN);
+    size = info.st_size;
+  }
+
+  // Misma direccion en todos los procesos: los punteros internos valen
+  base = mmap(SHARED_ADDRESS, size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_NORESERVE | MAP_FIXED_NOREPLACE, fd, 0);
+
+  // Kernels antiguos toman la direccion solo como pista
+  if (base != MAP_FAILED && base != SHARED_ADDRESS) {
+    munmap(base, size);
+    base = MAP_FAILED;
+  }
+
+  if (base != MAP_FAILED) {
+    attachedState = (tSharedState *)base;
+    attachedName = name;
+  }
+
+  // El creador conserva el cerrojo hasta publicar el estado
+  if (base == MAP_FAILED || !*created) {
+    close(fd);
+    return (base == MAP_FAILED) ? NULL : (tSharedState *)base;
+  }
+
+  creatorFd = fd;
+  state = (tSharedState *)base;
+  state->size = size;
+  state->region.base = (char *)base + offset;
+  state->region.size = size - offset;
+  state->region.used = 0;
+
+  return state;
+}
+
+void publishSharedState(tSharedState *state) {
+
+  __atomic_store_n(&(state->magic), SHARED_MAGIC, __ATOMIC_RELEASE);
+
+  // Los que esperan en lockSegment ya lo encuentran publicado
+  close(creatorFd);
+  creatorFd = -1;
+}
+
+void removeSharedState(const char *name) {
+
+  shm_unlink(name);
+
+  // Los que esperan ven que se ha borrado y abren uno nuevo
+  if (creatorFd >= 0) {
+    close(creatorFd);
+    creatorFd = -1;
+  }
+}
+
+void setProcessShared(int shared) {
+  processShared = shared;
+}
+
+void initSharedMutex(pthread_mutex_t *mutex) {
+
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+  if (processShared) {
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+    // Si un proceso muere con el mutex, el siguiente lo recibe (EOWNERDEAD)
+    // en lugar de quedarse bloqueado para siempre
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  }
+
+  pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void initSharedCond(pthread_cond_t *cond) {
+
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  if (processShared)
+    pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+void checkSharedLock(int error) {
+
+  if (attachedState == NULL)
+    return;
+
+  if (error == EOWNERDEAD || error == ENOTRECOVERABLE) {
+
+    // Solo el primero borra el segmento: luego puede haber uno nuevo
+    if (!__atomic_exchange_n(&(attachedState->poisoned), TRUE,
+                             __ATOMIC_ACQ_REL))
+      shm_unlink(attachedName);
+
+    fprintf(stderr, "[Shared] A process died holding a lock, stopping\n");
+    _exit(EXIT_FAILURE);
+  }
+
+  // Otro proceso ya lo ha detectado: el estado no es fiable
+  if (__atomic_load_n(&(attachedState->poisoned), __ATOMIC_ACQUIRE)) {
+    fprintf(stderr, "[Shared] The shared state is poisoned, stopping\n");
+    _exit(EXIT_FAILURE);
+  }
+}
+
+void waitSharedCond(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  checkSharedLock(pthread_cond_wait(cond, mutex));
+}
@@ -0,0 +1,114 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "matchmaking.h"
+#include "names.h"
+#include "slab.h"
+#include "table.h"
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Address of the shared segment in every process. All the processes map it at
+ * the same address, so the pointers inside it (names, chunks, slots) are valid
+ * in all of them.
+ */
+#define SHARED_ADDRESS ((void *)0x200000000000ULL)
+
+/** Magic number of an initialized segment */
+#define SHARED_MAGIC 0x424A534DU
+
+/**
+ * Server state that can be shared by several processes: the game table, the
+ * matchmaker and the name index. It starts the segment, and the memory after
+ * it (the memory budget of --max-memory) is handed out to their slabs.
+ */
+typedef struct sharedState {
+
+  uint32_t magic;         /** SHARED_MAGIC, once the state is initialized */
+  int poisoned;           /** TRUE once a process died holding one mutex */
+  size_t size;            /** Size of the segment */
+  tSlab region;           /** Memory budget of the table and the names */
+  tGameTable table;       /** Games */
+  tMatchmaker matchmaker; /** Waiting queue and free list */
+  tNameIndex nameIndex;   /** Names of the seated players */
+} tSharedState;
+
+/**
+ * Maps a POSIX shared memory segment at SHARED_ADDRESS, creating it if it
+ * does not exist. The process that creates it must initialize the state and
+ * then call publishSharedState; the others wait until it is published.
+ *
+ * The segment is locked (flock) while it is being initialized. If its creator
+ * dies before publishing it, the kernel releases the lock, and the next
+ * process finds the segment unpublished and creates it again from scratch.
+ *
+ * @param name Name of the segment (shm_open).
+ * @param regionSize Size of the region after the state, if it is created.
+ * @param created Set to TRUE if this process has created the segment.
+ * @return The state, or NULL on error.
+ */
+tSharedState *attachSharedState(const char *name, size_t regionSize,
+                                int *created);
+
+/**
+ * Marks the state of a new segment as initialized, so the processes waiting in
+ * attachSharedState can use it.
+ *
+ * @param state Shared state.
+ */
+void publishSharedState(tSharedState *state);
+
+/**
+ * Removes a segment (after its creator failed to initialize it).
+ *
+ * @param name Name of the segment.
+ */
+void removeSharedState(const char *name);
+
+/**
+ * Sets whether the sync primitives of the state must work across processes.
+ * Must be called before any of them is initialized.
+ *
+ * @param shared TRUE to use PTHREAD_PROCESS_SHARED.
+ */
+void setProcessShared(int shared);
+
+/**
+ * Initializes a mutex of the state (process-shared if needed). Process-shared
+ * mutexes are robust: if a process dies while holding one, the next one to
+ * lock it is told so (see checkSharedLock) instead of every other process
+ * blocking forever.
+ *
+ * @param mutex Mutex.
+ */
+void initSharedMutex(pthread_mutex_t *mutex);
+
+/**
+ * Initializes a condition variable of the state (process-shared if needed).
+ *
+ * @param cond Condition variable.
+ */
+void initSharedCond(pthread_cond_t *cond);
+
+/**
+ * Checks the result of locking a mutex of the state. If its owner died
+ * (EOWNERDEAD), the data it protects may be half updated and there is no way
+ * to tell which part: the state is marked as poisoned, its segment is
+ * unlinked (the next server creates a new one) and the process stops. The
+ * other processes stop as well the next time they lock any mutex of the
+ * state. Nothing is checked without --shared.
+ *
+ * @param error Result of pthread_mutex_lock (or trylock, or a wait).
+ */
+void checkSharedLock(int error);
+
+/**
+ * Waits on a condition variable of the state (see checkSharedLock).
+ *
+ * @param cond Condition variable.
+ * @param mutex Mutex (held).
+ */
+void waitSharedCond(pthread_cond_t *cond, pthread_mutex_t *mutex);
+
+#endif
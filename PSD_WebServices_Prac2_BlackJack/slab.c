@@ -0,0 +1,88 @@
+#include "slab.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/** Scratch arena of this thread (workers) */
+static __thread tArena *threadArena = NULL;
+
+int initSlab(tSlab *slab, size_t size, tSlab *parent) {
+
+  // Region dentro de otro slab (memoria compartida entre procesos)
+  if (parent != NULL) {
+    slab->base = (char *)slabAlloc(parent, size);
+    if (slab->base == NULL)
+      return -1;
+
+    slab->size = size;
+    slab->used = 0;
+    return 0;
+  }
+
+  // Solo se reserva el espacio de direcciones; las paginas llegan al tocarlas
+  slab->base = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (slab->base == MAP_FAILED)
+    return -1;
+
+  slab->size = size;
+  slab->used = 0;
+
+  return 0;
+}
+
+void *slabAlloc(tSlab *slab, size_t size) {
+
+  size_t offset;
+
+  size = (size + SLAB_ALIGNMENT - 1) & ~((size_t)SLAB_ALIGNMENT - 1);
+  offset = __atomic_fetch_add(&(slab->used), size, __ATOMIC_RELAXED);
+
+  // Agotado: used se queda por encima de size, asi que fallan todos los demas
+  if (offset + size > slab->size)
+    return NULL;
+
+  return slab->base + offset;
+}
+
+int initArena(tArena *arena, size_t size) {
+
+  arena->base = (char *)malloc(size);
+  if (arena->base == NULL)
+    return -1;
+
+  arena->size = size;
+  arena->used = 0;
+
+  return 0;
+}
+
+void *arenaAlloc(tArena *arena, size_t size) {
+
+  void *block;
+
+  size = (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+  if (arena->used + size > arena->size)
+    return NULL;
+
+  block = arena->base + arena->used;
+  arena->used += size;
+
+  return block;
+}
+
+void arenaReset(tArena *arena) {
+  arena->used = 0;
+}
+
+void freeArena(tArena *arena) {
+  free(arena->base);
+  arena->base = NULL;
+}
+
+void setThreadArena(tArena *arena) {
+  threadArena = arena;
+}
+
+tArena *getThreadArena() {
+  return threadArena;
+}
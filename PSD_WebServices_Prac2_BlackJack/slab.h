@@ -0,0 +1,106 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+/** Alignment of the blocks of a slab (a cache line) */
+#define SLAB_ALIGNMENT 64
+
+/** Alignment of the blocks of an arena */
+#define ARENA_ALIGNMENT 8
+
+/** Size of the scratch arena of each worker */
+#define WORKER_ARENA_SIZE (16 * 1024)
+
+/**
+ * Region of memory reserved at once (mmap) for long-lived server state. Blocks
+ * are handed out with an atomic bump of the used size: no lock and no call to
+ * malloc. The kernel only backs the pages that are touched, so the region can
+ * be as big as the memory limit. Blocks are never returned: their users keep
+ * their own free lists (see the matchmaker).
+ */
+typedef struct slab {
+
+  char *base;  /** Start of the region */
+  size_t size; /** Size of the region */
+  size_t used; /** Bytes already handed out (updated atomically) */
+} tSlab;
+
+/**
+ * Scratch memory of one thread, released all at once when a request ends.
+ */
+typedef struct arena {
+
+  char *base;  /** Start of the memory */
+  size_t size; /** Size of the memory */
+  size_t used; /** Bytes used by the current request */
+} tArena;
+
+/**
+ * Reserves the region of a slab. The memory is zero-filled.
+ *
+ * @param slab Slab to be initialized.
+ * @param size Size of the region.
+ * @param parent Slab the region is taken from (a shared segment), or NULL to
+ * map new private memory.
+ * @return 0 on success, -1 on error.
+ */
+int initSlab(tSlab *slab, size_t size, tSlab *parent);
+
+/**
+ * Gets a block of a slab (aligned to SLAB_ALIGNMENT). Safe to be called from
+ * several threads.
+ *
+ * @param slab Slab.
+ * @param size Size of the block.
+ * @return The block (zero-filled), or NULL if the slab is exhausted.
+ */
+void *slabAlloc(tSlab *slab, size_t size);
+
+/**
+ * Allocates the memory of an arena.
+ *
+ * @param arena Arena to be initialized.
+ * @param size Size of the arena.
+ * @return 0 on success, -1 on error.
+ */
+int initArena(tArena *arena, size_t size);
+
+/**
+ * Gets a block of an arena (aligned to ARENA_ALIGNMENT).
+ *
+ * @param arena Arena.
+ * @param size Size of the block.
+ * @return The block, or NULL if the arena is full.
+ */
+void *arenaAlloc(tArena *arena, size_t size);
+
+/**
+ * Releases all the blocks of an arena.
+ *
+ * @param arena Arena.
+ */
+void arenaReset(tArena *arena);
+
+/**
+ * Releases the memory of an arena.
+ *
+ * @param arena Arena.
+ */
+void freeArena(tArena *arena);
+
+/**
+ * Sets the scratch arena of the calling thread.
+ *
+ * @param arena Arena, or NULL if the thread has none.
+ */
+void setThreadArena(tArena *arena);
+
+/**
+ * Gets the scratch arena of the calling thread.
+ *
+ * @return Arena, or NULL if the thread has none.
+ */
+tArena *getThreadArena();
+
+#endif
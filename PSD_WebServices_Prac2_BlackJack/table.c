@@ -0,0 +1,177 @@
+#include "table.h"
+#include "shared.h"
+
+/** Memory used by one game, including its names (the decks are inside) */
+#define GAME_MEMORY (sizeof(tGame) + 2 * STRING_LENGTH)
+
+/** Memory used by one chunk of games */
+#define CHUNK_MEMORY (TABLE_CHUNK_SIZE * GAME_MEMORY)
+
+/** Rounds a size up to the alignment of the slab blocks */
+#define SLAB_ROUND(size)                                                       \
+  (((size) + SLAB_ALIGNMENT - 1) & ~((size_t)SLAB_ALIGNMENT - 1))
+
+/**
+ * Chunks of each shard for a number of games (rounded down to full chunks in
+ * all the shards).
+ */
+static int chunksPerShard(int maxGames) {
+  return maxGames / (TABLE_SHARDS * TABLE_CHUNK_SIZE);
+}
+
+/**
+ * Memory of the chunk directory of a shard.
+ */
+static size_t directoryMemory(int maxChunksPerShard) {
+  return SLAB_ROUND(maxChunksPerShard * sizeof(tGame *));
+}
+
+size_t gameTableMemory(int maxGames) {
+
+  int maxChunksPerShard = chunksPerShard(maxGames);
+
+  return SLAB_ROUND((size_t)maxChunksPerShard * TABLE_SHARDS *
+                        SLAB_ROUND(CHUNK_MEMORY) +
+                    TABLE_SHARDS * directoryMemory(maxChunksPerShard));
+}
+
+int initGameTable(tGameTable *table, int maxGames, tSlab *parent) {
+
+  size_t directorySize;
+
+  // El limite se redondea a chunks completos en todos los shards
+  table->maxChunksPerShard = chunksPerShard(maxGames);
+
+  if (table->maxChunksPerShard == 0)
+    return -1;
+
+  table->maxGames =
+      table->maxChunksPerShard * TABLE_SHARDS * TABLE_CHUNK_SIZE;
+  table->nextShard = 0;
+
+  // Toda la memoria de los juegos sale de un slab: crecer no llama a malloc.
+  // Los directorios de chunks tambien, para que la tabla pueda compartirse
+  directorySize = directoryMemory(table->maxChunksPerShard);
+  if (initSlab(&(table->slab), gameTableMemory(maxGames), parent) != 0)
+    return -1;
+
+  for (int i = 0; i < TABLE_SHARDS; i++) {
+    tTableShard *shard = &(table->shards[i]);
+
+    shard->chunks = (tGame **)slabAlloc(&(table->slab), directorySize);
+    if (shard->chunks == NULL)
+      return -1;
+
+    shard->numChunks = 0;
+    initSharedMutex(&(shard->mutex));
+  }
+
+  return 0;
+}
+
+tGame *getGame(tGameTable *table, int gameId) {
+
+  tTableShard *shard;
+  tGame *chunk;
+  int position;
+
+  if (gameId < 0 || gameId >= table->maxGames)
+    return NULL;
+
+  shard = &(table->shards[gameId % TABLE_SHARDS]);
+  position = gameId / TABLE_SHARDS;
+
+  // Los chunks nunca se liberan ni se mueven: basta con una lectura atomica
+  chunk = __atomic_load_n(&(shard->chunks[position / TABLE_CHUNK_SIZE]),
+                          __ATOMIC_ACQUIRE);
+
+  if (chunk == NULL)
+    return NULL;
+
+  return &(chunk[position % TABLE_CHUNK_SIZE]);
+}
+
+/**
+ * Allocates a new chunk of games for a shard. The shard mutex must be held.
+ */
+static tGame *growShard(tGameTable *table, tTableShard *shard,
+                        int shardIndex) {
+
+  tGame *chunk;
+  char *storage;
+  int chunkIndex = shard->numChunks;
+
+  if (chunkIndex == table->maxChunksPerShard)
+    return NULL;
+
+  // Bloque del slab (alineado a linea de cache y a cero): juegos y nombres
+  chunk = (tGame *)slabAlloc(&(table->slab), CHUNK_MEMORY);
+  if (chunk == NULL)
+    return NULL;
+
+  storage = (char *)(chunk + TABLE_CHUNK_SIZE);
+
+  // Names of every game come from the same block, after the games
+  for (int i = 0; i < TABLE_CHUNK_SIZE; i++) {
+    tGame *game = &(chunk[i]);
+
+    game->player1Name = (xsd__string)storage;
+    storage += STRING_LENGTH;
+    game->player2Name = (xsd__string)storage;
+    storage += STRING_LENGTH;
+
+    game->id =
+        ((chunkIndex * TABLE_CHUNK_SIZE) + i) * TABLE_SHARDS + shardIndex;
+    initGameSyncPrimitives(game);
+    initGameRng(game);
+    initGame(game);
+  }
+
+  __atomic_store_n(&(shard->chunks[chunkIndex]), chunk, __ATOMIC_RELEASE);
+  shard->numChunks++;
+
+  return chunk;
+}
+
+tGame *growGameTable(tGameTable *table) {
+
+  unsigned int first =
+      __atomic_fetch_add(&(table->nextShard), 1, __ATOMIC_RELAXED);
+
+  // Se empieza por un shard distinto cada vez; solo se recorren los demas
+  // cuando el primero no puede crecer mas
+  for (int i = 0; i < TABLE_SHARDS; i++) {
+    int shardIndex = (first + i) % TABLE_SHARDS;
+    tTableShard *shard = &(table->shards[shardIndex]);
+    tGame *chunk;
+
+    metricsLock(&(shard->mutex));
+    chunk = growShard(table, shard, shardIndex);
+    pthread_mutex_unlock(&(shard->mutex));
+
+    if (chunk != NULL)
+      return chunk;
+  }
+
+  return NULL;
+}
+
+tGame *allocGame(tGameTable *table, int gameId) {
+
+  tTableShard *shard;
+  tGame *game = getGame(table, gameId);
+
+  if (game != NULL || gameId < 0 || gameId >= table->maxGames)
+    return game;
+
+  shard = &(table->shards[gameId % TABLE_SHARDS]);
+
+  // Los chunks de un shard son consecutivos: crecer hasta llegar al del juego
+  metricsLock(&(shard->mutex));
+  while ((game = getGame(table, gameId)) == NULL &&
+         growShard(table, shard, gameId % TABLE_SHARDS) != NULL)
+    ;
+  pthread_mutex_unlock(&(shard->mutex));
+
+  return game;
+}
@@ -0,0 +1,91 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "server.h"
+#include "slab.h"
+#include <pthread.h>
+
+/** Number of shards of the game table (must be a power of 2) */
+#define TABLE_SHARDS 64
+
+/** Number of games allocated at once when a shard grows */
+#define TABLE_CHUNK_SIZE 64
+
+/** Default hard memory limit for the games and the names (in MB) */
+#define DEFAULT_MAX_MEMORY_MB 256
+
+/** Identifier used when there is no game */
+#define NO_GAME -1
+
+/**
+ * Shard of the game table. Game ids are striped across shards, so the game
+ * with id i lives in shard (i % TABLE_SHARDS) at position (i / TABLE_SHARDS).
+ */
+typedef struct tableShard {
+
+  pthread_mutex_t mutex; /** Protects the growth of this shard */
+  tGame **chunks;        /** Chunks of games (only the first numChunks) */
+  int numChunks;         /** Number of allocated chunks */
+} tTableShard;
+
+/**
+ * Growable table that contains all the games
+ */
+typedef struct gameTable {
+
+  int maxGames;          /** Hard limit of games (from the memory budget) */
+  int maxChunksPerShard; /** Size of the chunk directory of each shard */
+  unsigned int nextShard; /** Round-robin counter to spread new chunks */
+  tSlab slab;             /** Memory of the chunks and their directories */
+  tTableShard shards[TABLE_SHARDS];
+} tGameTable;
+
+/**
+ * Memory reserved by initGameTable for a number of games.
+ *
+ * @param maxGames Maximum number of games.
+ * @return Size of the slab of the table.
+ */
+size_t gameTableMemory(int maxGames);
+
+/**
+ * Initializes an empty table. The memory for the games is reserved, but no
+ * game is allocated until it is needed.
+ *
+ * @param table Table to be initialized.
+ * @param maxGames Hard limit of games (rounded down to full chunks in all the
+ * shards).
+ * @param parent Slab the memory is taken from (memory budget), or NULL.
+ * @return 0 on success, -1 on error (less than one chunk per shard).
+ */
+int initGameTable(tGameTable *table, int maxGames, tSlab *parent);
+
+/**
+ * Gets a game from its id in O(1).
+ *
+ * @param table Game table.
+ * @param gameId Id of the game.
+ * @return The game, or NULL if the id does not correspond to any game.
+ */
+tGame *getGame(tGameTable *table, int gameId);
+
+/**
+ * Grows the table with a new chunk of TABLE_CHUNK_SIZE empty games. Chunks are
+ * spread across the shards in round-robin.
+ *
+ * @param table Game table.
+ * @return The new chunk, or NULL if the memory limit has been reached.
+ */
+tGame *growGameTable(tGameTable *table);
+
+/**
+ * Gets a game from its id, growing its shard if needed (used to restore the
+ * games with their original ids). The new games are not in any list.
+ *
+ * @param table Game table.
+ * @param gameId Id of the game.
+ * @return The game, or NULL if the id does not fit in the memory limit.
+ */
+tGame *allocGame(tGameTable *table, int gameId);
+
+#endif
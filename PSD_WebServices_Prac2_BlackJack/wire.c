@@ -0,0 +1,247 @@
+#include "wire.h"
+#include "messages.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Size of the fixed part of a request (op, gameId, action, name length) */
+#define WIRE_REQUEST_SIZE 7
+
+/** Size of the fixed part of a response (code, message id, cards) */
+#define WIRE_RESPONSE_SIZE 6
+
+static void putInt(uint8_t *buffer, int value) {
+
+  uint32_t word = htonl((uint32_t)value);
+
+  memcpy(buffer, &word, sizeof(word));
+}
+
+static int getInt(uint8_t *buffer) {
+
+  uint32_t word;
+
+  memcpy(&word, buffer, sizeof(word));
+  return (int)ntohl(word);
+}
+
+/**
+ * Reads exactly size bytes (recv may return less).
+ */
+static int readAll(int fd, uint8_t *buffer, int size) {
+
+  int received;
+
+  while (size > 0) {
+    received = recv(fd, buffer, size, 0);
+    if (received <= 0)
+      return -1;
+    buffer += received;
+    size -= received;
+  }
+
+  return 0;
+}
+
+int wireReadFrame(int fd, uint8_t *frame) {
+
+  int length;
+
+  if (readAll(fd, frame, WIRE_HEADER_SIZE) != 0)
+    return -1;
+
+  length = (frame[0] << 8) | frame[1];
+  if (length > WIRE_MAX_FRAME - WIRE_HEADER_SIZE)
+    return -1;
+
+  if (readAll(fd, frame + WIRE_HEADER_SIZE, length) != 0)
+    return -1;
+
+  return length;
+}
+
+int wireWriteFrame(int fd, uint8_t *frame, int length) {
+
+  int sent, size = WIRE_HEADER_SIZE + length;
+
+  frame[0] = (length >> 8) & 0xFF;
+  frame[1] = length & 0xFF;
+
+  // Un solo send por frame (cabecera incluida)
+  while (size > 0) {
+    sent = send(fd, frame, size, MSG_NOSIGNAL);
+    if (sent <= 0)
+      return -1;
+    frame += sent;
+    size -= sent;
+  }
+
+  return 0;
+}
+
+int wirePackRequest(uint8_t *frame, tWireRequest *request) {
+
+  uint8_t *body = frame + WIRE_HEADER_SIZE;
+  int nameLength = request->playerName.__size;
+
+  if (nameLength > STRING_LENGTH - 1)
+    nameLength = STRING_LENGTH - 1;
+
+  body[0] = request->op;
+  putInt(body + 1, request->gameId);
+  body[5] = request->action;
+  body[6] = nameLength;
+  memcpy(body + WIRE_REQUEST_SIZE, request->playerName.msg, nameLength);
+
+  return WIRE_REQUEST_SIZE + nameLength;
+}
+
+int wireUnpackRequest(uint8_t *frame, int length, tWireRequest *request) {
+
+  uint8_t *body = frame + WIRE_HEADER_SIZE;
+
+  if (length < WIRE_REQUEST_SIZE || length != WIRE_REQUEST_SIZE + body[6])
+    return -1;
+
+  request->op = body[0];
+  request->gameId = getInt(body + 1);
+  request->action = body[5];
+  request->playerName.__size = body[6];
+  memcpy(request->playerName.msg, body + WIRE_REQUEST_SIZE, body[6]);
+  request->playerName.msg[body[6]] = 0;
+
+  return 0;
+}
+
+int wirePackResponse(uint8_t *frame, int code, blackJackns__tBlock *status) {
+
+  uint8_t *body = frame + WIRE_HEADER_SIZE;
+  int numCards = 0, msgLength = 0, msgId = WIRE_MSG_TEXT;
+  char *msg = NULL;
+
+  if (status != NULL) {
+    numCards = (status->deck).cards != NULL ? (status->deck).__size : 0;
+    msg = (status->msgStruct).msg;
+    msgLength = (status->msgStruct).__size;
+    if (msgLength > STRING_LENGTH - 1)
+      msgLength = STRING_LENGTH - 1;
+
+    // Mensaje del catalogo: solo se envian los argumentos
+    if (isPackedMessage(&(status->msgStruct))) {
+      msgId = (uint8_t)msg[1];
+      msg += 2;
+      msgLength = MSG_MAX_ARGS;
+    }
+  }
+
+  putInt(body, code);
+  body[4] = msgId;
+  body[5] = numCards;
+
+  // Un byte por carta (0..51)
+  for (int i = 0; i < numCards; i++)
+    body[WIRE_RESPONSE_SIZE + i] = (status->deck).cards[i];
+
+  if (msgLength > 0)
+    memcpy(body + WIRE_RESPONSE_SIZE + numCards, msg, msgLength);
+
+  return WIRE_RESPONSE_SIZE + numCards + msgLength;
+}
+
+int wireUnpackResponse(uint8_t *frame, int length,
+                       blackJackns__tBlock *status) {
+
+  uint8_t *body = frame + WIRE_HEADER_SIZE;
+  uint8_t *text;
+  int numCards, msgLength;
+
+  if (length < WIRE_RESPONSE_SIZE)
+    return -1;
+
+  numCards = body[5];
+  text = body + WIRE_RESPONSE_SIZE + numCards;
+  msgLength = length - WIRE_RESPONSE_SIZE - numCards;
+  if (numCards > DECK_SIZE || msgLength < 0 || msgLength > STRING_LENGTH - 1)
+    return -1;
+
+  status->code = getInt(body);
+
+  for (int i = 0; i < numCards; i++)
+    (status->deck).cards[i] = body[WIRE_RESPONSE_SIZE + i];
+  (status->deck).__size = numCards;
+
+  // Template del catalogo: se guarda empaquetado (ver renderMessage)
+  if (body[4] != WIRE_MSG_TEXT) {
+    if (msgLength != MSG_MAX_ARGS)
+      return -1;
+
+    packMessage(&(status->msgStruct), body[4], (int8_t)text[0],
+                (int8_t)text[1], (int8_t)text[2]);
+    return 0;
+  }
+
+  memcpy((status->msgStruct).msg, text, msgLength);
+  (status->msgStruct).msg[msgLength] = 0;
+  (status->msgStruct).__size = msgLength;
+
+  return 0;
+}
+
+int wireConnect(const char *url) {
+
+  char host[STRING_LENGTH];
+  const char *port;
+  struct addrinfo hints, *addresses, *address;
+  int fd = -1;
+
+  // bin://host:port
+  if (strncmp(url, WIRE_URL_PREFIX, strlen(WIRE_URL_PREFIX)) != 0)
+    return -1;
+
+  url += strlen(WIRE_URL_PREFIX);
+  port = strrchr(url, ':');
+  if (port == NULL || port - url >= STRING_LENGTH)
+    return -1;
+
+  memcpy(host, url, port - url);
+  host[port - url] = 0;
+  port++;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  if (getaddrinfo(host, port, &hints, &addresses) != 0)
+    return -1;
+
+  for (address = addresses; address != NULL; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype,
+                address->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(addresses);
+  return fd;
+}
+
+int wireCall(int fd, tWireRequest *request, blackJackns__tBlock *status) {
+
+  uint8_t frame[WIRE_MAX_FRAME];
+  int length;
+
+  length = wirePackRequest(frame, request);
+  if (wireWriteFrame(fd, frame, length) != 0)
+    return -1;
+
+  length = wireReadFrame(fd, frame);
+  if (length < 0)
+    return -1;
+
+  return wireUnpackResponse(frame, length, status);
+}
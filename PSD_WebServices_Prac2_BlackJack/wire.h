@@ -0,0 +1,128 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "soapH.h"
+#include <stdint.h>
+
+/*
+ * Compact binary protocol, an alternative to SOAP/XML for the same
+ * operations. Each frame is a 2-byte length (network byte order) followed by
+ * the body:
+ *
+ *   request:  op (1) | gameId (4) | action (1) | name length (1) | name
+ *   response: code (4) | message id (1) | number of cards (1) | cards (1 each)
+ *             | message text, or the arguments of the template (rest)
+ *
+ * Binary clients always receive the messages of the catalog as template ids
+ * (see messages.h), and render them locally.
+ *
+ * The response to register carries the result (game id or error) as code.
+ */
+
+/** Operations of the binary protocol */
+#define WIRE_REGISTER 1
+#define WIRE_GET_STATUS 2
+#define WIRE_PLAYER_MOVE 3
+
+/** Prefix of the server URL to use the binary protocol (client) */
+#define WIRE_URL_PREFIX "bin://"
+
+/** Size of the length that precedes each frame */
+#define WIRE_HEADER_SIZE 2
+
+/** Maximum size of a frame (length included) */
+#define WIRE_MAX_FRAME 512
+
+/** Message id: the text of the message follows the cards (not a template) */
+#define WIRE_MSG_TEXT 0
+
+/**
+ * Request of the binary protocol
+ */
+typedef struct wireRequest {
+
+  int op;                           /** Operation (WIRE_REGISTER...) */
+  int gameId;                       /** Game id (getStatus and playerMove) */
+  int action;                       /** Action (playerMove) */
+  blackJackns__tMessage playerName; /** Name (msg of STRING_LENGTH bytes) */
+} tWireRequest;
+
+/**
+ * Reads a whole frame from a socket.
+ *
+ * @param fd Socket.
+ * @param frame Buffer of WIRE_MAX_FRAME bytes.
+ * @return Length of the body, or -1 if the connection is closed or on error.
+ */
+int wireReadFrame(int fd, uint8_t *frame);
+
+/**
+ * Writes a frame (the length is filled in here).
+ *
+ * @param fd Socket.
+ * @param frame Frame whose body has already been packed.
+ * @param length Length of the body.
+ * @return 0 on success, -1 on error.
+ */
+int wireWriteFrame(int fd, uint8_t *frame, int length);
+
+/**
+ * Packs a request in the body of a frame.
+ *
+ * @param frame Buffer of WIRE_MAX_FRAME bytes.
+ * @param request Request to be packed.
+ * @return Length of the body.
+ */
+int wirePackRequest(uint8_t *frame, tWireRequest *request);
+
+/**
+ * Unpacks the request in the body of a frame.
+ *
+ * @param frame Frame read with wireReadFrame.
+ * @param length Length of the body.
+ * @param request Request where the fields are stored.
+ * @return 0 on success, -1 if the frame is malformed.
+ */
+int wireUnpackRequest(uint8_t *frame, int length, tWireRequest *request);
+
+/**
+ * Packs a response in the body of a frame.
+ *
+ * @param frame Buffer of WIRE_MAX_FRAME bytes.
+ * @param code Code to be sent (result of register).
+ * @param status Status to be sent, or NULL to send only the code.
+ * @return Length of the body.
+ */
+int wirePackResponse(uint8_t *frame, int code, blackJackns__tBlock *status);
+
+/**
+ * Unpacks the response in the body of a frame.
+ *
+ * @param frame Frame read with wireReadFrame.
+ * @param length Length of the body.
+ * @param status Status where the fields are stored (allocClearBlock).
+ * @return 0 on success, -1 if the frame is malformed.
+ */
+int wireUnpackResponse(uint8_t *frame, int length,
+                       blackJackns__tBlock *status);
+
+/**
+ * Connects to a server that speaks the binary protocol.
+ *
+ * @param url Server URL (bin://host:port).
+ * @return Connected socket, or -1 on error.
+ */
+int wireConnect(const char *url);
+
+/**
+ * Sends a request and waits for its response.
+ *
+ * @param fd Socket returned by wireConnect.
+ * @param request Request to be sent.
+ * @param status Status where the response is stored (allocClearBlock). The
+ * result of register is stored in its code.
+ * @return 0 on success, -1 on error.
+ */
+int wireCall(int fd, tWireRequest *request, blackJackns__tBlock *status);
+
+#endif